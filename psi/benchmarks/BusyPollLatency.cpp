@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#define LOG_TRACE(x)                                                                                                   \
+    do {                                                                                                               \
+    } while (0)
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+#include "psi/sm/BusyPollRunner.h"
+
+/**
+ * Ingress-to-react latency of a context driven by its own thread.
+ * Producer sends timestamped events at fixed pace, state records time between sending and reaction.
+ * Modes compared:
+ * - condvar: events are handed to consumer thread through std::mutex + std::condition_variable queue
+ * - busy-poll: events are sent through @BusyPollRunner, which owns context
+ *
+ * Usage: BusyPollLatency [events] [consumer cpu] [producer cpu] [pause between events, ns]
+ */
+
+namespace {
+
+using namespace psi::sm;
+using Clock = std::chrono::steady_clock;
+
+uint64_t nowNs()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+struct EvTick {
+    uint64_t sent;
+};
+
+struct ILatencyState {
+    virtual ~ILatencyState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvTick &) = 0;
+};
+
+struct LatencyContext : BaseContext<ILatencyState> {
+    LatencyContext(size_t events);
+
+    /// @brief latencies, written only by consumer thread
+    std::vector<uint64_t> latencies;
+};
+
+struct Measuring : BaseState<ILatencyState> {
+    Measuring()
+        : BaseState<ILatencyState>("Measuring")
+    {
+    }
+
+    ProcessResult react(const EvTick &ev) override
+    {
+        context<LatencyContext>()->latencies.emplace_back(nowNs() - ev.sent);
+        return discard_event();
+    }
+};
+
+LatencyContext::LatencyContext(size_t events)
+{
+    latencies.reserve(events);
+    transit<Measuring>();
+}
+
+void pinThread(int cpu)
+{
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+}
+
+void pace(uint64_t pauseNs)
+{
+    const uint64_t until = nowNs() + pauseNs;
+    while (nowNs() < until) {
+    }
+}
+
+std::vector<uint64_t> runCondvar(size_t events, int consumerCpu, int producerCpu, uint64_t pauseNs)
+{
+    LatencyContext context(events);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<EvTick> queue;
+    bool done = false;
+
+    std::thread consumer([&]() {
+        pinThread(consumerCpu);
+        for (;;) {
+            EvTick ev;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return !queue.empty() || done; });
+                if (queue.empty()) {
+                    return;
+                }
+                ev = queue.front();
+                queue.pop_front();
+            }
+            context.process_event(ev);
+        }
+    });
+
+    pinThread(producerCpu);
+    for (size_t i = 0; i < events; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(EvTick {nowNs()});
+        }
+        cv.notify_one();
+        pace(pauseNs);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    cv.notify_one();
+    consumer.join();
+
+    return context.latencies;
+}
+
+std::vector<uint64_t> runBusyPoll(size_t events, int consumerCpu, int producerCpu, uint64_t pauseNs)
+{
+    LatencyContext context(events);
+
+    BusyPollRunner<>::Config config;
+    config.cpu = consumerCpu;
+    BusyPollRunner<> runner(config);
+    runner.attach(context);
+    runner.start();
+
+    pinThread(producerCpu);
+    for (size_t i = 0; i < events; ++i) {
+        runner.send(context, EvTick {nowNs()});
+        pace(pauseNs);
+    }
+    runner.stop();
+
+    return context.latencies;
+}
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+void report(const std::string &mode, std::vector<uint64_t> latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(10) << mode << std::setw(10) << percentile(latencies, 0.5) << std::setw(10)
+              << percentile(latencies, 0.99) << std::setw(12) << percentile(latencies, 0.999) << std::setw(12)
+              << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const size_t events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const int consumerCpu = argc > 2 ? std::atoi(argv[2]) : -1;
+    const int producerCpu = argc > 3 ? std::atoi(argv[3]) : -1;
+    const uint64_t pauseNs = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 2000;
+
+    std::cout << "events: " << events << ", consumer cpu: " << consumerCpu << ", producer cpu: " << producerCpu
+              << ", pause: " << pauseNs << " ns" << std::endl;
+    std::cout << std::setw(10) << "mode" << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns" << std::setw(12)
+              << "p99.9 ns" << std::setw(12) << "max ns" << std::endl;
+
+    report("condvar", runCondvar(events, consumerCpu, producerCpu, pauseNs));
+    report("busy-poll", runBusyPoll(events, consumerCpu, producerCpu, pauseNs));
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#define LOG_TRACE(x)                                                                                                   \
+    do {                                                                                                               \
+    } while (0)
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+
+/**
+ * Memory footprint of idle contexts.
+ * Creates many contexts which have a state and no pending events and reports memory used per context:
+ * size of object plus heap owned by it. Result is compared with previous layout of BaseContext
+ * (three std::deque<Func> and std::recursive_mutex).
+ *
+ * Usage: ContextFootprint [number of contexts]
+ */
+
+namespace {
+
+std::atomic<int64_t> g_heap {0};
+
+} // namespace
+
+void *operator new(size_t size)
+{
+    auto *p = static_cast<size_t *>(std::malloc(size + sizeof(std::max_align_t)));
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    *p = size;
+    g_heap.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    return reinterpret_cast<char *>(p) + sizeof(std::max_align_t);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (!ptr) {
+        return;
+    }
+    auto *p = reinterpret_cast<size_t *>(static_cast<char *>(ptr) - sizeof(std::max_align_t));
+    g_heap.fetch_sub(static_cast<int64_t>(*p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+// std::pmr::new_delete_resource() uses aligned overloads, alignment of contexts and states is not extended
+void *operator new(size_t size, std::align_val_t)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+namespace {
+
+using namespace psi::sm;
+
+struct EvPing {
+};
+
+struct IIdleState {
+    virtual ~IIdleState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvPing &) = 0;
+};
+
+struct IdleState : BaseState<IIdleState> {
+    IdleState()
+        : BaseState<IIdleState>("IdleState")
+    {
+    }
+
+    ProcessResult react(const EvPing &) override
+    {
+        return discard_event();
+    }
+};
+
+struct IdleContext : BaseContext<IIdleState> {
+    IdleContext()
+    {
+        transit<IdleState>();
+    }
+};
+
+/// @brief previous layout of BaseContext
+struct LegacyContext {
+    using Func = std::function<ProcessResult()>;
+
+    LegacyContext()
+        : m_state(std::make_unique<IdleState>())
+    {
+    }
+
+    virtual ~LegacyContext() = default;
+
+    std::recursive_mutex m_mutex;
+    std::unique_ptr<IIdleState> m_state;
+    std::deque<Func> m_posted;
+    std::deque<Func> m_deferred;
+    std::deque<Func> m_queue;
+};
+
+template <typename Context>
+double bytesPerContext(size_t count, size_t &stateBytes)
+{
+    std::vector<std::unique_ptr<Context>> contexts;
+    contexts.reserve(count);
+
+    const auto before = g_heap.load();
+    for (size_t i = 0; i < count; ++i) {
+        contexts.emplace_back(std::make_unique<Context>());
+    }
+    const auto after = g_heap.load();
+
+    stateBytes = sizeof(IdleState);
+    return static_cast<double>(after - before) / static_cast<double>(count);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    size_t stateBytes = 0;
+    const double legacy = bytesPerContext<LegacyContext>(count, stateBytes);
+    const double compact = bytesPerContext<IdleContext>(count, stateBytes);
+
+    std::cout << "idle contexts: " << count << ", state object: " << stateBytes << " bytes" << std::endl;
+    std::cout << std::setw(10) << "layout" << std::setw(14) << "sizeof" << std::setw(18) << "bytes/context"
+              << std::setw(22) << "w/o state, bytes" << std::endl;
+    std::cout << std::setw(10) << "legacy" << std::setw(14) << sizeof(LegacyContext) << std::setw(18) << legacy
+              << std::setw(22) << legacy - static_cast<double>(stateBytes) << std::endl;
+    std::cout << std::setw(10) << "compact" << std::setw(14) << sizeof(IdleContext) << std::setw(18) << compact
+              << std::setw(22) << compact - static_cast<double>(stateBytes) << std::endl;
+    std::cout << "context overhead reduced " << std::setprecision(3)
+              << (legacy - static_cast<double>(stateBytes)) / (compact - static_cast<double>(stateBytes)) << "x"
+              << std::endl;
+
+    return 0;
+}
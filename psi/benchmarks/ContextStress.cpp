@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define LOG_TRACE(x)                                                                                                   \
+    do {                                                                                                               \
+    } while (0)
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+
+/**
+ * Stress harness of BaseContext under contention.
+ * Many threads fire random mix of 'process_event', 'post_event' and 'transit' against a few machines
+ * which heavily defer and post events. Harness checks that:
+ * - every work event of each producer is consumed exactly once and in order of sending
+ * - no deferred work event is left after machines return to working state
+ * Throughput and latency percentiles of context calls are reported for each number of threads.
+ *
+ * Usage: ContextStress [max threads] [operations per thread]
+ */
+
+namespace {
+
+using namespace psi::sm;
+
+struct EvWork {
+    uint32_t producer;
+    uint64_t seq;
+};
+
+struct EvToggle {
+};
+
+struct EvNoise {
+};
+
+struct IStressState {
+    virtual ~IStressState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvWork &) = 0;
+    virtual ProcessResult react(const EvToggle &) = 0;
+    virtual ProcessResult react(const EvNoise &) = 0;
+};
+
+struct StressContext : BaseContext<IStressState> {
+    explicit StressContext(size_t producers);
+
+    /// @brief last consumed sequence number of each producer, guarded by context
+    std::vector<uint64_t> consumed;
+    uint64_t violations = 0;
+    uint64_t noise = 0;
+
+    void consume(const EvWork &ev)
+    {
+        if (ev.seq != consumed[ev.producer] + 1) {
+            ++violations;
+        }
+        consumed[ev.producer] = ev.seq;
+    }
+
+    /// @brief events which are still waiting for another state, posted events may stay until next transition
+    size_t pending() const
+    {
+        return m_queues ? queueSize() - m_queues->posted.size() : 0;
+    }
+};
+
+struct Busy;
+
+struct Working : BaseState<IStressState> {
+    Working()
+        : BaseState<IStressState>("Working")
+    {
+    }
+
+    ProcessResult react(const EvWork &ev) override
+    {
+        context<StressContext>()->consume(ev);
+        if (ev.seq % 7 == 0) {
+            post_event(EvNoise {});
+        }
+        return discard_event();
+    }
+
+    ProcessResult react(const EvToggle &) override;
+
+    ProcessResult react(const EvNoise &) override
+    {
+        ++context<StressContext>()->noise;
+        return discard_event();
+    }
+};
+
+struct Busy : BaseState<IStressState> {
+    Busy()
+        : BaseState<IStressState>("Busy")
+    {
+    }
+
+    ProcessResult react(const EvWork &) override
+    {
+        return defer_event();
+    }
+
+    ProcessResult react(const EvToggle &) override
+    {
+        return transit<Working>();
+    }
+
+    ProcessResult react(const EvNoise &) override
+    {
+        return defer_event();
+    }
+};
+
+ProcessResult Working::react(const EvToggle &)
+{
+    return transit<Busy>(true);
+}
+
+StressContext::StressContext(size_t producers)
+    : consumed(producers, 0)
+{
+    transit<Working>();
+}
+
+struct RunResult {
+    double seconds = 0;
+    uint64_t operations = 0;
+    std::vector<uint64_t> latencies;
+};
+
+RunResult run(size_t threads, size_t machines, size_t opsPerThread, uint64_t &violations)
+{
+    std::vector<std::unique_ptr<StressContext>> contexts;
+    for (size_t i = 0; i < machines; ++i) {
+        contexts.emplace_back(std::make_unique<StressContext>(threads));
+    }
+
+    std::vector<std::vector<uint64_t>> latencies(threads);
+    std::vector<std::vector<uint64_t>> sent(threads, std::vector<uint64_t>(machines, 0));
+    std::atomic<bool> start {false};
+
+    auto producer = [&](uint32_t id) {
+        std::mt19937_64 rng(id + 1);
+        std::uniform_int_distribution<int> opDist(0, 99);
+        std::uniform_int_distribution<size_t> machineDist(0, machines - 1);
+        auto &lat = latencies[id];
+        lat.reserve(opsPerThread);
+
+        while (!start.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        for (size_t i = 0; i < opsPerThread; ++i) {
+            const size_t m = machineDist(rng);
+            auto &ctx = *contexts[m];
+            const int op = opDist(rng);
+
+            const auto begin = std::chrono::steady_clock::now();
+            if (op < 70) {
+                ctx.process_event(EvWork {id, ++sent[id][m]});
+            } else if (op < 80) {
+                ctx.process_event(EvToggle {});
+            } else if (op < 90) {
+                ctx.post_event(EvNoise {});
+            } else if (op < 95) {
+                ctx.transit<Busy>();
+            } else {
+                ctx.transit<Working>();
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            lat.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back(producer, static_cast<uint32_t>(t));
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto &w : workers) {
+        w.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    for (size_t m = 0; m < machines; ++m) {
+        auto &ctx = *contexts[m];
+        ctx.transit<Working>();
+
+        violations += ctx.violations;
+        for (size_t t = 0; t < threads; ++t) {
+            if (ctx.consumed[t] != sent[t][m]) {
+                std::cerr << "machine " << m << ", producer " << t << ": consumed " << ctx.consumed[t] << " of "
+                          << sent[t][m] << std::endl;
+                ++violations;
+            }
+        }
+        if (ctx.pending()) {
+            std::cerr << "machine " << m << ": " << ctx.pending() << " deferred events left" << std::endl;
+            ++violations;
+        }
+    }
+
+    RunResult result;
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+    for (auto &lat : latencies) {
+        result.operations += lat.size();
+        result.latencies.insert(result.latencies.end(), lat.begin(), lat.end());
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+
+    return result;
+}
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const size_t hw = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const size_t maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2 * hw;
+    const size_t opsPerThread = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    const size_t machines = 4;
+
+    std::cout << "machines: " << machines << ", operations per thread: " << opsPerThread << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "ops/s" << std::setw(10) << "p50 ns" << std::setw(10)
+              << "p99 ns" << std::setw(12) << "p99.9 ns" << std::setw(12) << "max ns" << std::endl;
+
+    uint64_t violations = 0;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        const auto rs = run(threads, machines, opsPerThread, violations);
+        std::cout << std::setw(8) << threads << std::setw(14) << static_cast<uint64_t>(rs.operations / rs.seconds)
+                  << std::setw(10) << percentile(rs.latencies, 0.5) << std::setw(10)
+                  << percentile(rs.latencies, 0.99) << std::setw(12) << percentile(rs.latencies, 0.999)
+                  << std::setw(12) << (rs.latencies.empty() ? 0 : rs.latencies.back()) << std::endl;
+    }
+
+    if (violations) {
+        std::cerr << "FAILED: " << violations << " invariant violations" << std::endl;
+        return 1;
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
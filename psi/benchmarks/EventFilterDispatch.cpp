@@ -0,0 +1,138 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#define LOG_TRACE(x)                                                                                                   \
+    do {                                                                                                               \
+    } while (0)
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+
+/**
+ * Cost of broadcasting events which current state does not handle.
+ * State interface has 8 events, state reacts on one of them. Broadcast sends all 8 events in a loop.
+ * Modes compared:
+ * - virtual: state relies on default 'react' overloads returning UnconsumedEvent
+ * - filtered: state declares 'HandledEvents', unhandled events are dropped by context without virtual call
+ *
+ * Usage: EventFilterDispatch [rounds]
+ */
+
+namespace {
+
+using namespace psi::sm;
+using Clock = std::chrono::steady_clock;
+
+template <int N>
+struct Ev {
+    uint64_t value;
+};
+
+struct IBroadcastState {
+    virtual ~IBroadcastState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const Ev<0> &) = 0;
+
+    virtual ProcessResult react(const Ev<1> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+
+    virtual ProcessResult react(const Ev<2> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+
+    virtual ProcessResult react(const Ev<3> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+
+    virtual ProcessResult react(const Ev<4> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+
+    virtual ProcessResult react(const Ev<5> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+
+    virtual ProcessResult react(const Ev<6> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+
+    virtual ProcessResult react(const Ev<7> &)
+    {
+        return ProcessResult::UnconsumedEvent;
+    }
+};
+
+struct BroadcastContext : BaseContext<IBroadcastState> {
+    uint64_t sum = 0;
+};
+
+struct VirtualState : BaseState<IBroadcastState> {
+    VirtualState()
+        : BaseState<IBroadcastState>("VirtualState")
+    {
+    }
+
+    using IBroadcastState::react;
+
+    ProcessResult react(const Ev<0> &ev) override
+    {
+        context<BroadcastContext>()->sum += ev.value;
+        return discard_event();
+    }
+};
+
+struct FilteredState : VirtualState {
+    using HandledEvents = EventList<Ev<0>>;
+};
+
+template <int... Ns>
+void broadcast(BroadcastContext &context, uint64_t value, std::integer_sequence<int, Ns...>)
+{
+    (context.process_event(Ev<Ns> {value}), ...);
+}
+
+template <typename State>
+double run(size_t rounds)
+{
+    BroadcastContext context;
+    context.transit<State>();
+
+    const auto start = Clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        broadcast(context, i, std::make_integer_sequence<int, 8>());
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+    if (context.sum != rounds * (rounds - 1) / 2) {
+        std::cerr << "unexpected sum" << std::endl;
+    }
+    return static_cast<double>(ns) / static_cast<double>(rounds * 8);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const size_t rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000000;
+
+    std::cout << "rounds: " << rounds << ", events per round: 8, handled: 1" << std::endl;
+    std::cout << std::setw(10) << "mode" << std::setw(14) << "ns/event" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(10) << "virtual" << std::setw(14) << run<VirtualState>(rounds) << std::endl;
+    std::cout << std::setw(10) << "filtered" << std::setw(14) << run<FilteredState>(rounds) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+# Generation of switch-dispatched state machines by SmCodegen (see psi/tools/SmCodegen.cpp).
+#
+# psi_sm_generate(<variable> <description>)
+#   Generates '<name>Machine.h' from '<name>.sm' description into build directory at build time.
+#   Path of generated header is stored in <variable>, it should be added to sources of target,
+#   e.g. passed to psi_make_examples or psi_make_tests. Build directory of generated headers is
+#   added to include directories.
+
+set(PSI_SM_GENERATED_DIR ${CMAKE_CURRENT_BINARY_DIR}/generated)
+
+function(psi_sm_generate variable description)
+    get_filename_component(name ${description} NAME_WE)
+    get_filename_component(input ${description} ABSOLUTE)
+    set(output ${PSI_SM_GENERATED_DIR}/${name}Machine.h)
+
+    add_custom_command(
+        OUTPUT ${output}
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${PSI_SM_GENERATED_DIR}
+        COMMAND SmCodegen ${input} ${output}
+        DEPENDS SmCodegen ${input}
+        COMMENT "Generating ${name}Machine.h from ${name}.sm"
+        VERBATIM
+    )
+
+    include_directories(${PSI_SM_GENERATED_DIR})
+    set(${variable} ${output} PARENT_SCOPE)
+endfunction()
@@ -0,0 +1,67 @@
+#include <cstdint>
+#include <iostream>
+
+#include "DoorMachine.h"
+
+namespace psi::examples {
+
+/// @brief Actions and guards of generated door machine.
+struct DoorActions {
+    using Machine = DoorMachine<DoorActions>;
+
+    void rememberCode(Machine &, const EvLock &ev)
+    {
+        code = ev.code;
+    }
+
+    bool codeMatches(const Machine &, const EvUnlock &ev) const
+    {
+        return ev.code == code;
+    }
+
+    void alarm(Machine &, const EvUnlock &ev)
+    {
+        std::cout << "wrong code " << ev.code << std::endl;
+    }
+
+    void greet(Machine &, const EvKnock &)
+    {
+        std::cout << "come in" << std::endl;
+    }
+
+    void onOpened(Machine &)
+    {
+        std::cout << "door is opened" << std::endl;
+    }
+
+    void onLocked(Machine &)
+    {
+        std::cout << "door is locked" << std::endl;
+    }
+
+    void onUnlocked(Machine &)
+    {
+        std::cout << "door is unlocked" << std::endl;
+    }
+
+    uint32_t code = 0;
+};
+
+} // namespace psi::examples
+
+int main()
+{
+    using namespace psi::examples;
+
+    DoorActions actions;
+    DoorMachine<DoorActions> door(actions);
+
+    door.process_event(EvKnock {});      // opened by knock, knock is re-processed by Opened: "come in"
+    door.process_event(EvLock {1234});   // deferred until door is closed
+    door.process_event(EvClose {});      // closed, then locked by deferred event
+    door.process_event(EvOpen {});       // deferred until door is unlocked
+    door.process_event(EvUnlock {1111}); // wrong code
+    door.process_event(EvUnlock {1234}); // unlocked, then opened by deferred event
+
+    std::cout << "state: " << to_string(door.state()) << std::endl;
+}
@@ -0,0 +1,499 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include "BaseContext.h"
+#include "SharedEvent.h"
+
+namespace psi::sm {
+
+class Actor;
+class ActorSystem;
+
+template <typename IState>
+class ActorContext;
+
+/// @brief Returns tag of state interface, identifies type of receiver without RTTI.
+template <typename IState>
+const void *stateTagOf()
+{
+    static const char tag = 0;
+    return &tag;
+}
+
+/**
+ * @brief Address is a typed mailbox address of @ActorContext<IState>.
+ * Type of address defines events which may be sent to receiver.
+ * Ids are never reused, so address of destroyed actor never reaches another actor. Messages sent to
+ * address whose type does not match receiver (e.g. address made from id of another actor) are dropped.
+ *
+ * @tparam IState state interface of receiver
+ */
+template <typename IState>
+struct Address {
+    static constexpr uint32_t InvalidId = std::numeric_limits<uint32_t>::max();
+
+    uint32_t id = InvalidId;
+
+    bool valid() const
+    {
+        return id != InvalidId;
+    }
+
+    friend bool operator==(const Address &a, const Address &b)
+    {
+        return a.id == b.id;
+    }
+
+    friend bool operator!=(const Address &a, const Address &b)
+    {
+        return a.id != b.id;
+    }
+};
+
+/**
+ * @brief Message is a type-erased shared event addressed to actor.
+ */
+struct Message {
+    /// @brief function which passes event to receiver, bound to types of receiver and event.
+    /// Returns false if receiver has another state interface.
+    using DeliverFn = bool (*)(Actor *, const std::shared_ptr<const void> &);
+
+    uint32_t to;
+    DeliverFn deliver;
+    std::shared_ptr<const void> event;
+
+    /**
+     * @brief Creates message for receiver with specified address.
+     *
+     * @tparam IState state interface of receiver
+     * @tparam T type of event
+     * @param to address of receiver
+     * @param ev shared event object
+     * @return Message message object
+     */
+    template <typename IState, typename T>
+    static Message make(Address<IState> to, SharedEvent<T> ev)
+    {
+        return Message {to.id, &deliver_impl<IState, T>, std::move(ev)};
+    }
+
+private:
+    template <typename IState, typename T>
+    static bool deliver_impl(Actor *actor, const std::shared_ptr<const void> &ev);
+};
+
+/**
+ * @brief Actor is a registration of mailbox in @ActorSystem.
+ * Each actor has unique id, id defines shard of system which delivers messages to actor.
+ */
+class Actor
+{
+public:
+    /// @brief Returns id of actor's mailbox.
+    uint32_t id() const
+    {
+        return m_id;
+    }
+
+    /// @brief Returns tag of actor's state interface.
+    const void *stateTag() const
+    {
+        return m_stateTag;
+    }
+
+    /// @brief Delivers messages sent by actor during processing of events.
+    virtual void flush() = 0;
+
+protected:
+    inline Actor(ActorSystem &system, const void *stateTag);
+    inline virtual ~Actor();
+
+    /// @brief system which owns mailbox
+    ActorSystem &m_system;
+
+    /// @brief id of mailbox
+    const uint32_t m_id;
+
+    /// @brief tag of state interface, checked on delivery
+    const void *const m_stateTag;
+
+private:
+    Actor(const Actor &) = delete;
+    Actor &operator=(const Actor &) = delete;
+};
+
+/**
+ * @brief ActorSystem delivers messages between contexts without locking receivers from sender's reactions.
+ * The concept is:
+ * - every @ActorContext gets a mailbox address
+ * - messages are buffered by sender and handed over to system in batches, one lock per destination shard
+ * - event sent to many receivers is shared by all of them, event object is never copied
+ * - messages of each shard are delivered by single dispatching thread calling 'dispatch(shard)'
+ *
+ * Actors must not be created or destroyed while their shard is dispatched.
+ */
+class ActorSystem
+{
+public:
+    /**
+     * @brief Construct a new ActorSystem object.
+     *
+     * @param shards number of shards, at least one
+     */
+    explicit ActorSystem(size_t shards = 1)
+    {
+        m_shards.resize(shards ? shards : 1);
+        for (auto &shard : m_shards) {
+            shard = std::make_unique<Shard>();
+        }
+    }
+
+    /// @brief Returns number of shards.
+    size_t shards() const
+    {
+        return m_shards.size();
+    }
+
+    /// @brief Returns shard which delivers messages to actor with specified id.
+    size_t shardOf(uint32_t id) const
+    {
+        return id % m_shards.size();
+    }
+
+    /**
+     * @brief Sends event to receiver from outside of any actor.
+     * Operation is thread-safe.
+     *
+     * @tparam IState state interface of receiver
+     * @tparam T type of event
+     * @param to address of receiver
+     * @param ev event object
+     */
+    template <typename IState, typename T>
+    void send(Address<IState> to, const T &ev)
+    {
+        send(to, make_shared_event<T>(ev));
+    }
+
+    /**
+     * @brief Sends shared event to receiver from outside of any actor.
+     * Operation is thread-safe.
+     *
+     * @tparam IState state interface of receiver
+     * @tparam T type of event
+     * @param to address of receiver
+     * @param ev shared event object
+     */
+    template <typename IState, typename T>
+    void send(Address<IState> to, SharedEvent<T> ev)
+    {
+        auto &shard = *m_shards[shardOf(to.id)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.inbox.emplace_back(Message::make(to, std::move(ev)));
+    }
+
+    /**
+     * @brief Moves batch of messages to inbox of shard.
+     * Operation is thread-safe.
+     *
+     * @param shard index of shard
+     * @param batch messages, all of them are addressed to the shard. Batch is cleared.
+     */
+    void enqueue(size_t shard, std::vector<Message> &batch)
+    {
+        auto &sh = *m_shards[shard];
+        {
+            std::lock_guard<std::mutex> lock(sh.mutex);
+            if (sh.inbox.empty()) {
+                sh.inbox.swap(batch);
+            } else {
+                sh.inbox.insert(sh.inbox.end(),
+                                std::make_move_iterator(batch.begin()),
+                                std::make_move_iterator(batch.end()));
+            }
+        }
+        batch.clear();
+    }
+
+    /**
+     * @brief Delivers all messages currently queued to shard.
+     * Receivers process events without shard's lock, messages they send are flushed after each delivery.
+     * Only one thread may dispatch the same shard at the same time.
+     *
+     * @param shard index of shard
+     * @return size_t number of delivered messages
+     */
+    size_t dispatch(size_t shard)
+    {
+        auto &sh = *m_shards[shard];
+        {
+            std::lock_guard<std::mutex> lock(sh.mutex);
+            sh.drained.swap(sh.inbox);
+            sh.receivers.clear();
+            for (const auto &msg : sh.drained) {
+                const size_t slot = msg.to / m_shards.size();
+                sh.receivers.emplace_back(slot < sh.actors.size() ? sh.actors[slot] : nullptr);
+            }
+        }
+
+        size_t delivered = 0;
+        for (size_t i = 0; i < sh.drained.size(); ++i) {
+            auto *actor = sh.receivers[i];
+            if (!actor) {
+                continue;
+            }
+
+            const auto &msg = sh.drained[i];
+            if (!msg.deliver(actor, msg.event)) {
+                continue;
+            }
+            actor->flush();
+            ++delivered;
+        }
+        sh.drained.clear();
+
+        return delivered;
+    }
+
+    /**
+     * @brief Delivers messages of all shards from calling thread.
+     *
+     * @return size_t number of delivered messages
+     */
+    size_t dispatch()
+    {
+        size_t delivered = 0;
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            delivered += dispatch(i);
+        }
+        return delivered;
+    }
+
+private:
+    friend class Actor;
+
+    uint32_t attach(Actor *actor)
+    {
+        const uint32_t id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+        auto &sh = *m_shards[shardOf(id)];
+        const size_t slot = id / m_shards.size();
+
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        if (sh.actors.size() <= slot) {
+            sh.actors.resize(slot + 1, nullptr);
+        }
+        sh.actors[slot] = actor;
+
+        return id;
+    }
+
+    void detach(uint32_t id)
+    {
+        auto &sh = *m_shards[shardOf(id)];
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        sh.actors[id / m_shards.size()] = nullptr;
+    }
+
+    struct Shard {
+        std::mutex mutex;
+
+        /// @brief messages waiting for delivery
+        std::vector<Message> inbox;
+
+        /// @brief registered actors, indexed by 'id / shards'
+        std::vector<Actor *> actors;
+
+        /// @brief messages and their receivers being delivered, owned by dispatching thread
+        std::vector<Message> drained;
+        std::vector<Actor *> receivers;
+    };
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::atomic<uint32_t> m_nextId {0};
+};
+
+Actor::Actor(ActorSystem &system, const void *stateTag)
+    : m_system(system)
+    , m_id(system.attach(this))
+    , m_stateTag(stateTag)
+{
+}
+
+Actor::~Actor()
+{
+    m_system.detach(m_id);
+}
+
+/**
+ * @brief Outbox buffers messages of sender grouped by destination shard.
+ * Not thread-safe, owner is responsible for synchronization.
+ */
+class Outbox
+{
+public:
+    explicit Outbox(ActorSystem &system)
+        : m_system(system)
+        , m_batches(system.shards())
+    {
+    }
+
+    /**
+     * @brief Buffers message to receiver.
+     *
+     * @tparam IState state interface of receiver
+     * @tparam T type of event
+     * @param to address of receiver
+     * @param ev shared event object
+     */
+    template <typename IState, typename T>
+    void send(Address<IState> to, SharedEvent<T> ev)
+    {
+        m_batches[m_system.shardOf(to.id)].emplace_back(Message::make(to, std::move(ev)));
+        ++m_pending;
+    }
+
+    /// @brief Hands over buffered messages to system, one batch per destination shard.
+    void flush()
+    {
+        if (!m_pending) {
+            return;
+        }
+
+        for (size_t i = 0; i < m_batches.size(); ++i) {
+            if (!m_batches[i].empty()) {
+                m_system.enqueue(i, m_batches[i]);
+            }
+        }
+        m_pending = 0;
+    }
+
+    /// @brief Returns number of buffered messages.
+    size_t size() const
+    {
+        return m_pending;
+    }
+
+private:
+    ActorSystem &m_system;
+    std::vector<std::vector<Message>> m_batches;
+    size_t m_pending = 0;
+};
+
+/**
+ * @brief ActorContext is a context reachable through mailbox address of @ActorSystem.
+ * States send events to other contexts via 'context<DerivedContext>()->send(address, event)',
+ * receiver's lock is never taken by sender.
+ *
+ * @tparam IState
+ */
+template <typename IState>
+class ActorContext
+    : public BaseContext<IState>
+    , public Actor
+{
+public:
+    /**
+     * @brief Construct a new ActorContext object and registers its mailbox in system.
+     *
+     * @param system system delivering messages
+     * @param resource memory resource of states and queued events, e.g. arena of shard
+     */
+    explicit ActorContext(ActorSystem &system,
+                          std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : BaseContext<IState>(resource)
+        , Actor(system, stateTagOf<IState>())
+        , m_outbox(system)
+    {
+    }
+
+    /// @brief Returns mailbox address of context.
+    Address<IState> address() const
+    {
+        return Address<IState> {m_id};
+    }
+
+    /**
+     * @brief Sends event to receiver. Delivery happens on 'flush()'.
+     * Operation is thread-safe.
+     *
+     * @tparam IReceiverState state interface of receiver
+     * @tparam T type of event
+     * @param to address of receiver
+     * @param ev event object
+     */
+    template <typename IReceiverState, typename T>
+    void send(Address<IReceiverState> to, const T &ev)
+    {
+        send(to, make_shared_event<T>(ev));
+    }
+
+    /**
+     * @brief Sends shared event to receiver. Delivery happens on 'flush()'.
+     * Operation is thread-safe.
+     *
+     * @tparam IReceiverState state interface of receiver
+     * @tparam T type of event
+     * @param to address of receiver
+     * @param ev shared event object
+     */
+    template <typename IReceiverState, typename T>
+    void send(Address<IReceiverState> to, SharedEvent<T> ev)
+    {
+        std::lock_guard<typename BaseContext<IState>::Mutex> lock(this->m_mutex);
+        m_outbox.send(to, std::move(ev));
+    }
+
+    /**
+     * @brief Sends single copy of event to many receivers. Delivery happens on 'flush()'.
+     * Operation is thread-safe.
+     *
+     * @tparam IReceiverState state interface of receivers
+     * @tparam T type of event
+     * @param to addresses of receivers
+     * @param ev event object
+     */
+    template <typename IReceiverState, typename T>
+    void send(const std::vector<Address<IReceiverState>> &to, const T &ev)
+    {
+        const auto shared = make_shared_event<T>(ev);
+
+        std::lock_guard<typename BaseContext<IState>::Mutex> lock(this->m_mutex);
+        for (const auto &addr : to) {
+            m_outbox.send(addr, shared);
+        }
+    }
+
+    /**
+     * @brief Hands over sent messages to system.
+     * Called by system after each delivery to context, should be called by owner after 'process_event'.
+     * Operation is thread-safe.
+     */
+    void flush() override
+    {
+        std::lock_guard<typename BaseContext<IState>::Mutex> lock(this->m_mutex);
+        m_outbox.flush();
+    }
+
+protected:
+    /// @brief messages sent by context's states
+    Outbox m_outbox;
+};
+
+template <typename IState, typename T>
+bool Message::deliver_impl(Actor *actor, const std::shared_ptr<const void> &ev)
+{
+    if (actor->stateTag() != stateTagOf<IState>()) {
+        return false;
+    }
+    static_cast<ActorContext<IState> *>(actor)->process_event(std::static_pointer_cast<const T>(ev));
+    return true;
+}
+
+} // namespace psi::sm
@@ -1,28 +1,66 @@
 
 #pragma once
 
-#include <deque>
-#include <functional>
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #ifdef PSI_LOGGER
 #include "psi/logger/Logger.h"
 #else
 #include <iostream>
 #include <sstream>
+#ifndef LOG_TRACE_STATIC
 #define LOG_TRACE_STATIC(x)                                                                                            \
     do {                                                                                                               \
         std::ostringstream os;                                                                                         \
         os << x;                                                                                                       \
         std::cout << os.str() << std::endl;                                                                            \
     } while (0)
+#endif
+#ifndef LOG_TRACE
 #define LOG_TRACE(x) LOG_TRACE_STATIC(x)
 #endif
+#endif
+
+#ifdef PSI_SM_TRACE
+#include <typeinfo>
+
+#include "Tracer.h"
+#define PSI_SM_TRACE_SCOPE(scope, type, name) ::psi::sm::trace::Scope scope(::psi::sm::trace::RecordType::type, this, name)
+#define PSI_SM_TRACE_RESULT(scope, rs) scope.result(rs)
+#define PSI_SM_TRACE_INSTANT(type, ...) ::psi::sm::trace::instant(::psi::sm::trace::RecordType::type, this, __VA_ARGS__)
+#else
+#define PSI_SM_TRACE_SCOPE(scope, type, name)
+#define PSI_SM_TRACE_RESULT(scope, rs)
+#define PSI_SM_TRACE_INSTANT(type, ...)
+#endif
+
+#ifdef PSI_SM_WATCHDOG
+#include "ReactionWatchdog.h"
+#define PSI_SM_WATCH_REACTION(scope, stateId, eventId)                                                                 \
+    ::psi::sm::watchdog::Reaction scope(this, stateId, eventId)
+#else
+#define PSI_SM_WATCH_REACTION(scope, stateId, eventId)
+#endif
 
 #include "BaseState.h"
+#include "CompactRecursiveMutex.h"
+#include "EventFilter.h"
+#include "ExpiringEvent.h"
+#include "HazardPointers.h"
 #include "ProcessResult.h"
+#include "RequestEvent.h"
+#include "ResourceFunction.h"
+#include "SharedEvent.h"
+#include "StateId.h"
+#include "TransitionObserver.h"
 
 namespace psi::sm {
 
@@ -30,11 +68,19 @@ namespace psi::sm {
  * @brief BaseContext class is a thread-safe state machine.
  * The concept is:
  * - only one state @BaseState<IState> exists at any time
- * - events can be anything fast copyable
+ * - events can be anything fast copyable, big events may be wrapped into @SharedEvent<T>
  * - posted events are always processed before deferred events
  * - deferred events are re-processed only after state is changed
  * - IState is a state interface with at least one 'ProcessResult react(const T &event)' method:
  *      virtual ProcessResult react(const EvExample&) { return ProcessResult::UnconsumedEvent; }
+ * - states may declare 'on_entry()' and 'on_exit()' hooks, transitions may be watched by @TransitionObserver<IState>
+ * - states and queued events are allocated from context's std::pmr::memory_resource
+ * - current state may be observed from any thread without locking, see 'observeState'
+ * - @ExpiringEvent<T> is dropped without reaction once its deadline passed or its token is cancelled
+ * - events and transitions requested by state during reaction are handled after reaction, stack depth is constant
+ * - states may declare 'HandledEvents' and 'DeferredEvents' (@EventList), other events are unconsumed or
+ *   deferred by context without virtual call to state, see @EventFilter
+ * - @RequestEvent<T> reports result of its final reaction and resulting state to @RequestFuture, see 'request_event'
  * 
  * @todo requires small optimizations in events passing through sequences
  * 
@@ -44,16 +90,78 @@ template <typename IState>
 class BaseContext
 {
 public:
-    virtual ~BaseContext() = default;
+    /**
+     * @brief Construct a new BaseContext object.
+     *
+     * @param resource memory resource of states and queued events, must outlive context
+     */
+    explicit BaseContext(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : m_resource(resource)
+    {
+    }
+
+    virtual ~BaseContext()
+    {
+        if (auto *st = state()) {
+            m_state.store(nullptr, std::memory_order_seq_cst);
+            retire(st, m_stateOps);
+        }
+        while (m_retired) {
+            std::this_thread::yield();
+            reclaimRetired();
+        }
+        destroyQueues();
+    }
 
     /// @brief In fact this is a type of functions which are processed by queue. These will capture events to be processed later.
-    using Func = std::function<ProcessResult()>;
+    using Func = ResourceFunction<ProcessResult()>;
 
     /// @brief Short alias to base state type.
     using IBaseState = BaseState<IState>;
 
+    /// @brief Type of context's lock. It is recursive because state may also call context's methods during event processing.
+    using Mutex = CompactRecursiveMutex;
+
+    /// @brief Container of queued functions.
+    using FuncQueue = std::pmr::vector<Func>;
+
+    /// @brief min size of deferred queue at which expired events are removed from it
+    static constexpr size_t MinPurgeSize = 16;
+
+    /// @brief Event queues of context. These are allocated only while context has pending events.
+    struct Queues {
+        explicit Queues(std::pmr::memory_resource *resource)
+            : posted(resource)
+            , deferred(resource)
+            , queue(resource)
+            , incoming(resource)
+            , purgers(resource)
+        {
+        }
+
+        /// @brief queue of posted events, is processed with highest priority
+        FuncQueue posted;
+
+        /// @brief queue of deferred events, is processed with lowest priority
+        FuncQueue deferred;
+
+        /// @brief main processing events queue, events before 'head' are already processed
+        FuncQueue queue;
+        size_t head = 0;
+
+        /// @brief events passed to 'process_event' during reaction, processed by outermost call in order of arrival
+        FuncQueue incoming;
+
+        /// @brief removers of expired events, one per queued type of expiring event
+        std::pmr::vector<size_t (*)(FuncQueue &, size_t)> purgers;
+
+        /// @brief size of deferred queue which triggers next removal of expired events
+        size_t purgeAt = MinPurgeSize;
+    };
+
     /**
      * @brief Processes event in accordence with current state.
+     * If called by state during reaction, event is queued and processed once outermost reaction is finished.
      * 
      * @tparam T type of event
      * @param ev evnt object
@@ -61,9 +169,223 @@ public:
     template <typename T>
     void process_event(const T &ev)
     {
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if (dropUnhandled(ev)) {
+            return;
+        }
+
+        std::lock_guard<Mutex> lock(m_mutex);
+
+        if (m_dispatching) {
+            queues().incoming.emplace_back(DispatchTask<T> {this, ev}, m_resource);
+            return;
+        }
+
+        DispatchGuard guard(m_dispatching);
+        dispatch(ev);
+        drainIncoming();
+    }
+
+    /**
+     * @brief Processes event and returns future which completes once event leaves context's queues:
+     * by reaction with final result, by being dropped (expired, cancelled or destroyed with context).
+     * Deferred and posted events complete later, when they are re-processed.
+     * Must not be waited by state during reaction if event may be queued.
+     * Operation is thread-safe, completion does not allocate once pool of completions is warmed up.
+     *
+     * @tparam T type of event
+     * @param ev event object
+     * @return RequestFuture future of request
+     */
+    template <typename T>
+    RequestFuture request_event(const T &ev)
+    {
+        RequestEvent<T> request(ev);
+        auto future = request.future();
+        process_event(request);
+        return future;
+    }
+
+    /**
+     * @brief Posts event to be processed with high priority.
+     * Operation is thread-safe.
+     * 
+     * @tparam T type of event
+     * @param ev event object
+     */
+    template <typename T>
+    void post_event(const T &ev)
+    {
+        std::lock_guard<Mutex> lock(m_mutex);
+        PSI_SM_TRACE_INSTANT(Post, typeid(event_ref(ev)).name());
+
+        queues().posted.emplace_back(EventTask<T> {this, ev}, m_resource);
+        trackExpiring<T>();
+        // LOG_TRACE("[" << m_state->name() << "] post " << tools::objName(ev) << ". Queue size: " << queueSize());
+    }
+
+    /**
+     * @brief Removes pending events of type T matching predicate, without reaction on them.
+     * Events of type T are matched whether they are queued as is, as @SharedEvent<T> or as @ExpiringEvent.
+     * Operation is thread-safe.
+     *
+     * @tparam T type of event reacted by states
+     * @tparam Pred type of predicate
+     * @param pred predicate 'bool(const T &)'
+     * @return size_t number of removed events
+     */
+    template <typename T, typename Pred>
+    size_t cancel_deferred(Pred &&pred)
+    {
+        std::lock_guard<Mutex> lock(m_mutex);
+
+        if (!m_queues) {
+            return 0;
+        }
+
+        const auto matches = [&](const Func &fn) {
+            const T *ev = queuedEvent<T>(fn);
+            return ev && pred(*ev);
+        };
+
+        auto &q = *m_queues;
+        size_t removed = q.deferred.size();
+        q.deferred.erase(std::remove_if(q.deferred.begin(), q.deferred.end(), matches), q.deferred.end());
+        removed -= q.deferred.size();
+
+        // deferred events being re-processed right now
+        const auto pending = q.queue.size();
+        q.queue.erase(std::remove_if(q.queue.begin() + q.head, q.queue.end(), matches), q.queue.end());
+        removed += pending - q.queue.size();
+
+        releaseQueues();
+        return removed;
+    }
+
+    /**
+     * @brief Removes pending events which expired or were cancelled (see @ExpiringEvent), without reaction on them.
+     * Context also does it itself whenever deferred queue doubles, so queue of context which does not change state
+     * is bounded by events which are still alive.
+     * Operation is thread-safe.
+     *
+     * @return size_t number of removed events
+     */
+    size_t purge_expired()
+    {
+        std::lock_guard<Mutex> lock(m_mutex);
+
+        if (!m_queues) {
+            return 0;
+        }
+
+        auto &q = *m_queues;
+        size_t removed = 0;
+        for (auto purge : q.purgers) {
+            removed += purge(q.deferred, 0);
+            removed += purge(q.posted, 0);
+            removed += purge(q.queue, q.head);
+        }
+
+        releaseQueues();
+        return removed;
+    }
+
+    /**
+     * @brief Performs transition from old state (if exists) to new state.
+     * If called by state during reaction, queued events are processed once outermost reaction is finished.
+     * Operation is thread-safe.
+     * 
+     * @tparam NextState type of new state
+     */
+    template <typename NextState>
+    void transit()
+    {
+        std::lock_guard<Mutex> lock(m_mutex);
+
+        transit_impl<NextState>();
+        if (m_dispatching) {
+            // called by state during reaction: queue is processed once reaction is finished
+            m_transited = true;
+            return;
+        }
+
+        DispatchGuard guard(m_dispatching);
+        process_queue();
+        drainIncoming();
+    }
+
+    /**
+     * @brief Returns pointer to current state if it exists.
+     * 
+     * @return std::optional<IState *> 
+     */
+    std::optional<IState *> currentState() const
+    {
+        auto *st = state();
+        return st ? std::make_optional<IState *>(st) : std::nullopt;
+    }
+
+    /**
+     * @brief Calls function with current state without taking context's lock.
+     * Operation is thread-safe and lock-free: state is not destroyed while function runs,
+     * though it may be replaced by another state meanwhile. Function must only use const methods of state
+     * which do not depend on context, e.g. 'name()'. At most 4 calls may be nested in one thread,
+     * deeper call throws std::length_error.
+     *
+     * @tparam Fn type of function
+     * @param fn function 'R(const IState *)', receives nullptr if state does not exist
+     * @return result of function
+     */
+    template <typename Fn>
+    auto observeState(Fn &&fn) const
+    {
+        HazardDomain::Guard guard;
+        const IState *st = guard.protect(m_state);
+        return fn(st);
+    }
+
+    /**
+     * @brief Returns lock of context.
+     * Executor owning context's thread may hold it while running, then reactions take it recursively
+     * without atomic operations (see @BusyPollRunner).
+     */
+    Mutex &mutex()
+    {
+        return m_mutex;
+    }
+
+    /// @brief Returns memory resource of context. States may use it for their own objects.
+    std::pmr::memory_resource *memoryResource() const
+    {
+        return m_resource;
+    }
+
+    /**
+     * @brief Returns identifier of current state type.
+     * Operation is thread-safe and lock-free.
+     *
+     * @return StateId identifier of state, InvalidStateId if state does not exist
+     */
+    StateId currentStateId() const
+    {
+        return m_stateId.load(std::memory_order_acquire);
+    }
+
+protected:
+    /**
+     * @brief Processes event by current state and handles result of reaction.
+     *
+     * @tparam T type of event
+     * @param ev event object
+     * @return ProcessResult result of reaction
+     */
+    template <typename T>
+    ProcessResult dispatch(const T &ev)
+    {
+        PSI_SM_TRACE_SCOPE(traceScope, Event, typeid(event_ref(ev)).name());
 
         auto rs = process_event_impl(ev);
+        PSI_SM_TRACE_RESULT(traceScope, rs);
+        complete_request(ev, rs, currentStateId());
 
         switch (rs) {
         case ProcessResult::UnknownState:
@@ -75,10 +397,10 @@ public:
             break;
 
         case ProcessResult::DeferredEvent:
-            m_deferred.emplace_back([this, ev]() {
-                // LOG_TRACE("[" << m_state->name() << "] process deferred " << tools::objName(ev) << ". Queue size: " << queueSize());
-                return process_event_impl(ev);
-            });
+            PSI_SM_TRACE_INSTANT(Defer, typeid(event_ref(ev)).name());
+            queues().deferred.emplace_back(EventTask<T> {this, ev}, m_resource);
+            trackExpiring<T>();
+            purgeDeferred();
             // LOG_TRACE("[" << m_state->name() << "] defer " << tools::objName(ev) << ". Queue size: " << queueSize());
             break;
 
@@ -88,10 +410,9 @@ public:
             break;
 
         case ProcessResult::PostedEvent:
-            m_posted.emplace_back([this, ev]() {
-                // LOG_TRACE("[" << m_state->name() << "] process posted " << tools::objName(ev) << ". Queue size: " << queueSize());
-                return process_event_impl(ev);
-            });
+            PSI_SM_TRACE_INSTANT(Post, typeid(event_ref(ev)).name());
+            queues().posted.emplace_back(EventTask<T> {this, ev}, m_resource);
+            trackExpiring<T>();
             // LOG_TRACE("[" << m_state->name() << "] posted " << tools::objName(ev) << ". Queue size: " << queueSize());
             process_queue();
             break;
@@ -104,53 +425,125 @@ public:
             // LOG_TRACE("[" << m_state->name() << "] discarded " << tools::objName(ev) << ". Queue size: " << queueSize());
             break;
         }
+
+        if (m_transited) {
+            // state performed transition but reported another result
+            process_queue();
+        }
+        return rs;
+    }
+
+    /// @brief Registers remover of expired events of type T once it is queued.
+    template <typename T>
+    void trackExpiring()
+    {
+        if constexpr (IsExpiring<T>::value) {
+            auto &purgers = m_queues->purgers;
+            if (std::find(purgers.begin(), purgers.end(), &purgeExpired<T>) == purgers.end()) {
+                purgers.emplace_back(&purgeExpired<T>);
+            }
+        }
     }
 
     /**
-     * @brief Posts event to be processed with high priority.
-     * Operation is thread-safe.
-     * 
-     * @tparam T type of event
-     * @param ev event object
+     * @brief Removes queued expired events of type T, their requests are completed as dropped.
+     *
+     * @tparam T type of expiring event
+     * @param queue queue of events
+     * @param from index of first event to be checked
+     * @return size_t number of removed events
      */
     template <typename T>
-    void post_event(const T &ev)
+    static size_t purgeExpired(FuncQueue &queue, size_t from)
     {
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        const auto expired = [](const Func &fn) {
+            const auto *task = fn.template target<EventTask<T>>();
+            if (!task || !is_expired(task->ev)) {
+                return false;
+            }
+            complete_request(task->ev, ProcessResult::DiscardedEvent, InvalidStateId);
+            return true;
+        };
 
-        m_posted.emplace_back([this, ev]() {
-            // LOG_TRACE("[" << m_state->name() << "] process posted " << tools::objName(ev) << ". Queue size: " << queueSize());
-            return process_event_impl(ev);
-        });
-        // LOG_TRACE("[" << m_state->name() << "] post " << tools::objName(ev) << ". Queue size: " << queueSize());
+        const auto size = queue.size();
+        queue.erase(std::remove_if(queue.begin() + from, queue.end(), expired), queue.end());
+        return size - queue.size();
     }
 
-    /**
-     * @brief Performs transition from old state (if exists) to new state.
-     * Operation is thread-safe.
-     * 
-     * @tparam NextState type of new state
-     */
-    template <typename NextState>
-    void transit()
+    /// @brief Removes expired deferred events once deferred queue doubled since previous removal.
+    void purgeDeferred()
     {
-        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        auto &q = *m_queues;
+        if (q.purgers.empty() || q.deferred.size() < q.purgeAt) {
+            return;
+        }
 
-        transit_impl<NextState>();
-        process_queue();
+        for (auto purge : q.purgers) {
+            purge(q.deferred, 0);
+        }
+        q.purgeAt = std::max(MinPurgeSize, 2 * q.deferred.size());
+    }
+
+    /// @brief Processes events passed to 'process_event' during reactions, in order of arrival.
+    void drainIncoming()
+    {
+        while (m_queues && !m_queues->incoming.empty()) {
+            FuncQueue batch(m_resource);
+            batch.swap(m_queues->incoming);
+            for (auto &fn : batch) {
+                fn();
+            }
+        }
+        releaseQueues();
     }
 
     /**
-     * @brief Returns pointer to current state if it exists.
-     * 
-     * @return std::optional<IState *> 
+     * @brief Drops event which current state does not handle (see @EventFilter) without dispatching it.
+     * Event is dropped only if context is idle: its lock is free (not held by reaction or by executor owning
+     * context, see @BusyPollRunner), so no reaction, transition or posted event is pending and state is final.
+     * Otherwise event takes usual path and keeps its order relative to pending work.
+     * Handled events pay one verdict lookup here, lock is tried for unhandled events only.
+     *
+     * @tparam T type of event
+     * @param ev event object
+     * @return true if event is dropped
      */
-    std::optional<IState *> currentState() const
+    template <typename T>
+    bool dropUnhandled(const T &ev)
     {
-        return m_state ? std::make_optional<IState *>(m_state.get()) : std::nullopt;
+        using E = std::decay_t<decltype(event_ref(ev))>;
+        using Filter = EventFilter<IState>;
+        if (Filter::template verdict<E>(m_stateId.load(std::memory_order_relaxed)) != Filter::Verdict::Unconsumed
+            || m_mutex.ownedByCurrentThread() || !m_mutex.try_lock()) {
+            return false;
+        }
+
+        // state may have changed before lock was taken
+        const auto id = m_stateId.load(std::memory_order_relaxed);
+        const bool drop = Filter::template verdict<E>(id) == Filter::Verdict::Unconsumed;
+        if (drop) {
+            complete_request(ev, ProcessResult::UnconsumedEvent, id);
+        }
+        m_mutex.unlock();
+        return drop;
     }
 
-protected:
+    /// @brief Marks context as dispatching reactions while guard exists.
+    struct DispatchGuard {
+        explicit DispatchGuard(bool &flag)
+            : m_flag(flag)
+        {
+            m_flag = true;
+        }
+
+        ~DispatchGuard()
+        {
+            m_flag = false;
+        }
+
+        bool &m_flag;
+    };
+
     /**
      * @brief Performs transition from old state (if exists) to new state.
      * 
@@ -159,18 +552,183 @@ protected:
     template <typename NewState>
     void transit_impl()
     {
-        IBaseState *st = new NewState();
+        void *mem = m_resource->allocate(sizeof(NewState), alignof(NewState));
+        NewState *newState = nullptr;
+        try {
+            newState = ::new (mem) NewState();
+        } catch (...) {
+            m_resource->deallocate(mem, sizeof(NewState), alignof(NewState));
+            throw;
+        }
+        IBaseState *st = newState;
         st->m_context = this;
+        EventFilter<IState>::template declare<NewState>();
 
+        auto *oldState = state();
         const auto newSt = st->name();
-        if (m_state) {
-            const auto oldSt = m_state->name();
+        if (oldState) {
+            const auto oldSt = oldState->name();
             LOG_TRACE("[" << oldSt << "] => [" << newSt << "] transition");
+            PSI_SM_TRACE_INSTANT(Transit, typeid(NewState).name(), typeid(*oldState).name());
+            m_stateOps->exit(oldState);
         } else {
             LOG_TRACE("[" << newSt << "] Initialize state");
+            PSI_SM_TRACE_INSTANT(Transit, typeid(NewState).name());
+        }
+
+        TransitionObserver<IState>::on_transition(*this, oldState, *newState);
+
+        const auto *oldOps = m_stateOps;
+        m_stateOps = &StateOpsOf<NewState>::ops;
+        m_stateId.store(StateIds<IState>::template of<NewState>(), std::memory_order_release);
+        m_state.store(newState, std::memory_order_seq_cst);
+
+        reclaimRetired();
+        if (oldState) {
+            retire(oldState, oldOps);
         }
+        newState->on_entry();
+    }
 
-        m_state.reset(st);
+    /// @brief Returns current state. Must be called by owner of lock.
+    IState *state() const
+    {
+        return m_state.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Operations on current state which depend on its type. Bound during transition.
+    struct StateOps {
+        /// @brief calls exit hook of state
+        void (*exit)(IState *);
+
+        /// @brief destroys state and returns its memory to resource
+        void (*destroy)(IState *, std::pmr::memory_resource *);
+#ifdef PSI_SM_WATCHDOG
+
+        /// @brief returns watchdog id of state type
+        watchdog::TypeId (*watchId)();
+#endif
+    };
+
+    template <typename State>
+    struct StateOpsOf {
+        static void exit(IState *st)
+        {
+            static_cast<State *>(st)->on_exit();
+        }
+
+        static void destroy(IState *st, std::pmr::memory_resource *resource)
+        {
+            auto *state = static_cast<State *>(st);
+            state->~State();
+            resource->deallocate(state, sizeof(State), alignof(State));
+        }
+
+#ifdef PSI_SM_WATCHDOG
+        static constexpr StateOps ops = {&exit, &destroy, &watchdog::stateId<State>};
+#else
+        static constexpr StateOps ops = {&exit, &destroy};
+#endif
+    };
+
+    /**
+     * @brief Queued reaction on event. Named type lets context find queued events by their type.
+     *
+     * @tparam T type of event
+     */
+    template <typename T>
+    struct EventTask {
+        BaseContext *context;
+        T ev;
+
+        ProcessResult operator()() const
+        {
+            // LOG_TRACE("[" << m_state->name() << "] process queued " << tools::objName(ev) << ". Queue size: " << queueSize());
+            auto rs = context->process_event_impl(ev);
+            complete_request(ev, rs, context->currentStateId());
+            return rs;
+        }
+    };
+
+    /**
+     * @brief Event passed to 'process_event' during reaction.
+     *
+     * @tparam T type of event
+     */
+    template <typename T>
+    struct DispatchTask {
+        BaseContext *context;
+        T ev;
+
+        ProcessResult operator()() const
+        {
+            return context->dispatch(ev);
+        }
+    };
+
+    /**
+     * @brief Returns event reacted by queued function if it is of type T.
+     *
+     * @tparam T type of event reacted by states
+     * @param fn queued function
+     * @return const T* event object, nullptr if function reacts on event of other type
+     */
+    template <typename T>
+    static const T *queuedEvent(const Func &fn)
+    {
+        const T *result = nullptr;
+        const auto find = [&](auto *tag) {
+            using Task = EventTask<std::remove_pointer_t<decltype(tag)>>;
+            if (const auto *task = fn.template target<Task>()) {
+                result = &event_ref(task->ev);
+            }
+            return result != nullptr;
+        };
+        (void)(find(static_cast<T *>(nullptr)) || find(static_cast<SharedEvent<T> *>(nullptr))
+               || find(static_cast<ExpiringEvent<T> *>(nullptr))
+               || find(static_cast<ExpiringEvent<SharedEvent<T>> *>(nullptr))
+               || find(static_cast<RequestEvent<T> *>(nullptr))
+               || find(static_cast<RequestEvent<SharedEvent<T>> *>(nullptr)));
+        return result;
+    }
+
+    /// @brief Replaced state which is still observed by other threads.
+    struct Retired {
+        IState *state;
+        const StateOps *ops;
+        Retired *next;
+    };
+
+    /**
+     * @brief Destroys replaced state or keeps it until it is no longer observed.
+     *
+     * @param st state which is not published anymore
+     * @param ops operations of state
+     */
+    void retire(IState *st, const StateOps *ops)
+    {
+        if (!HazardDomain::instance().isProtected(st)) {
+            ops->destroy(st, m_resource);
+            return;
+        }
+
+        void *mem = m_resource->allocate(sizeof(Retired), alignof(Retired));
+        m_retired = ::new (mem) Retired {st, ops, m_retired};
+    }
+
+    /// @brief Destroys retired states which are no longer observed.
+    void reclaimRetired()
+    {
+        auto **link = &m_retired;
+        while (auto *r = *link) {
+            if (HazardDomain::instance().isProtected(r->state)) {
+                link = &r->next;
+                continue;
+            }
+            *link = r->next;
+            r->ops->destroy(r->state, m_resource);
+            m_resource->deallocate(r, sizeof(Retired), alignof(Retired));
+        }
     }
 
     /**
@@ -186,7 +744,29 @@ protected:
         // if (m_state) {
         //     LOG_TRACE("[" << m_state->name() << "] react " << tools::objName(ev) << ". Queue size: " << queueSize());
         // }
-        return m_state ? m_state->react(ev) : ProcessResult::UnknownState;
+        if (is_expired(ev)) {
+            PSI_SM_TRACE_INSTANT(Expire, typeid(event_ref(ev)).name());
+            complete_request(ev, ProcessResult::DiscardedEvent, InvalidStateId);
+            return ProcessResult::DiscardedEvent;
+        }
+        auto *st = state();
+        if (!st) {
+            return ProcessResult::UnknownState;
+        }
+
+        using T = std::decay_t<decltype(event_ref(ev))>;
+        switch (EventFilter<IState>::template verdict<T>(m_stateId.load(std::memory_order_relaxed))) {
+        case EventFilter<IState>::Verdict::Unconsumed:
+            return ProcessResult::UnconsumedEvent;
+        case EventFilter<IState>::Verdict::Defer:
+            return ProcessResult::DeferredEvent;
+        case EventFilter<IState>::Verdict::React:
+            break;
+        }
+        PSI_SM_WATCH_REACTION(watchScope,
+                              m_stateOps ? m_stateOps->watchId() : ::psi::sm::watchdog::InvalidId,
+                              ::psi::sm::watchdog::eventId<T>());
+        return st->react(event_ref(ev));
     }
 
     /**
@@ -200,79 +780,165 @@ protected:
         // LOG_TRACE("m_posted: " << m_posted.size() << ", m_deferred: " << m_deferred.size()
         //                        << ", m_queue: " << m_queue.size());
 
-        m_queue.insert(m_queue.begin(), m_posted.begin(), m_posted.end());
-        m_posted.clear();
-
-        m_queue.insert(m_queue.end(), m_deferred.begin(), m_deferred.end());
-        m_deferred.clear();
-
-        if (m_queue.empty()) {
-            return;
-        }
+        m_transited = false;
+        while (m_queues) {
+            auto &q = *m_queues;
+            prepareQueue(q);
 
-        bool transitionFound = false;
-        while (!m_queue.empty()) {
-            auto fn = m_queue.front();
-            m_queue.pop_front();
+            if (q.queue.empty()) {
+                releaseQueues();
+                return;
+            }
 
-            auto rs = fn();
+            PSI_SM_TRACE_SCOPE(traceScope, Queue, "process_queue");
+
+            ++m_processing;
+            bool transitionFound = false;
+            while (q.head < q.queue.size()) {
+                auto fn = std::move(q.queue[q.head++]);
+
+                auto rs = fn();
+
+                switch (rs) {
+                case ProcessResult::DeferredEvent:
+                    PSI_SM_TRACE_INSTANT(Defer, "deferred");
+                    q.deferred.emplace_back(std::move(fn));
+                    // LOG_TRACE("[" << m_state->name() << "] re-defer event. Queue size: " << queueSize());
+                    break;
+
+                case ProcessResult::TransitState:
+                    transitionFound = true;
+                    break;
+
+                case ProcessResult::PostedEvent:
+                    PSI_SM_TRACE_INSTANT(Post, "posted");
+                    q.posted.emplace_back(std::move(fn));
+                    // LOG_TRACE("[" << m_state->name() << "] post event. Queue size: " << queueSize());
+                    transitionFound = true;
+                    break;
+
+                case ProcessResult::DiscardedEvent:
+                    // LOG_TRACE("[" << m_state->name() << "] discard event. Queue size: " << queueSize());
+                    break;
+
+                case ProcessResult::UnknownState:
+                case ProcessResult::UnknownContext:
+                case ProcessResult::UnconsumedEvent:
+                    break;
+                }
+
+                if (transitionFound || m_transited) {
+                    transitionFound = true;
+                    m_transited = false;
+                    break;
+                }
+            }
+            --m_processing;
 
-            switch (rs) {
-            case ProcessResult::DeferredEvent:
-                m_deferred.emplace_back(fn);
-                // LOG_TRACE("[" << m_state->name() << "] re-defer event. Queue size: " << queueSize());
-                break;
+            if (q.head == q.queue.size()) {
+                q.queue.clear();
+                q.head = 0;
+            }
 
-            case ProcessResult::TransitState:
-                transitionFound = true;
-                break;
+            // state is changed: restart processing in a loop, so stack depth does not grow
+            if (!transitionFound) {
+                releaseQueues();
+                return;
+            }
+        }
+    }
 
-            case ProcessResult::PostedEvent:
-                m_posted.emplace_back(fn);
-                // LOG_TRACE("[" << m_state->name() << "] post event. Queue size: " << queueSize());
-                transitionFound = true;
-                break;
+    size_t queueSize() const
+    {
+        return m_queues ? m_queues->deferred.size() + m_queues->posted.size() + m_queues->queue.size() - m_queues->head
+                              + m_queues->incoming.size()
+                        : 0;
+    }
 
-            case ProcessResult::DiscardedEvent:
-                // LOG_TRACE("[" << m_state->name() << "] discard event. Queue size: " << queueSize());
-                break;
+    /**
+     * @brief Builds main queue of events to be processed: posted events, then not yet processed events, then deferred.
+     *
+     * @param q queues of context
+     */
+    static void prepareQueue(Queues &q)
+    {
+        if (!q.posted.empty()) {
+            q.posted.insert(q.posted.end(),
+                            std::make_move_iterator(q.queue.begin() + q.head),
+                            std::make_move_iterator(q.queue.end()));
+            q.queue.swap(q.posted);
+            q.posted.clear();
+        } else if (q.head) {
+            q.queue.erase(q.queue.begin(), q.queue.begin() + q.head);
+        }
+        q.head = 0;
 
-            case ProcessResult::UnknownState:
-            case ProcessResult::UnknownContext:
-            case ProcessResult::UnconsumedEvent:
-                break;
-            }
+        q.queue.insert(q.queue.end(), std::make_move_iterator(q.deferred.begin()), std::make_move_iterator(q.deferred.end()));
+        q.deferred.clear();
+    }
 
-            if (transitionFound) {
-                break;
-            }
+    /**
+     * @brief Returns event queues, allocates them on first use.
+     *
+     * @return Queues& queues of context
+     */
+    Queues &queues()
+    {
+        if (!m_queues) {
+            void *mem = m_resource->allocate(sizeof(Queues), alignof(Queues));
+            m_queues = ::new (mem) Queues(m_resource);
         }
+        return *m_queues;
+    }
 
-        if (transitionFound) {
-            process_queue();
+    /// @brief Frees event queues if all of them are drained and not being processed.
+    void releaseQueues()
+    {
+        if (m_queues && !m_processing && !queueSize()) {
+            destroyQueues();
         }
     }
 
-    size_t queueSize() const
+    /// @brief Frees event queues with all pending events.
+    void destroyQueues()
     {
-        return m_deferred.size() + m_posted.size() + m_queue.size();
+        if (m_queues) {
+            m_queues->~Queues();
+            m_resource->deallocate(m_queues, sizeof(Queues), alignof(Queues));
+            m_queues = nullptr;
+        }
     }
 
 protected:
     /// @brief recursive mutex is used because state may also call context's methods during event processing
-    std::recursive_mutex m_mutex;
+    Mutex m_mutex;
+
+    /// @brief state's lifetime is limited and managed by context, pointer is published for lock-free observers
+    std::atomic<IState *> m_state {nullptr};
+
+    /// @brief type-dependent operations of current state, valid only if state exists
+    const StateOps *m_stateOps = nullptr;
+
+    /// @brief event queues, nullptr if context has no pending events
+    Queues *m_queues = nullptr;
+
+    /// @brief replaced states still observed by other threads
+    Retired *m_retired = nullptr;
+
+    /// @brief memory resource of states and queues
+    std::pmr::memory_resource *m_resource;
 
-    /// @brief state's lifetime is limited and managed by context
-    std::unique_ptr<IState> m_state;
+    /// @brief identifier of current state type
+    std::atomic<StateId> m_stateId {InvalidStateId};
 
-    /// @brief queue of posted events, is processed with highest priority
-    std::deque<Func> m_posted;
+    /// @brief depth of nested 'process_queue' loops, queues are not released while they are processed
+    uint16_t m_processing = 0;
 
-    /// @brief queue of deferred events, is processed with lowest priority
-    std::deque<Func> m_deferred;
+    /// @brief true while context is dispatching reactions, re-entrant calls are turned into enqueues
+    bool m_dispatching = false;
 
-    /// @brief main processing events queue
-    std::deque<Func> m_queue;
+    /// @brief true if state performed transition during reaction, queue is to be processed after reaction
+    bool m_transited = false;
 
 private:
     // BaseContext(const BaseContext &) = delete;
@@ -27,6 +27,24 @@ public:
         return m_name;
     }
 
+    /**
+     * @brief Called by context right after state became current one.
+     * Derived state may declare its own public 'void on_entry()', context binds it statically by state type.
+     * Hook must not perform transitions.
+     */
+    void on_entry()
+    {
+    }
+
+    /**
+     * @brief Called by context right before state is replaced by another one.
+     * Derived state may declare its own public 'void on_exit()', context binds it statically by state type.
+     * Hook must not perform transitions.
+     */
+    void on_exit()
+    {
+    }
+
 protected:
     /**
      * @brief Construct a new BaseState object.
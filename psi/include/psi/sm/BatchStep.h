@@ -0,0 +1,221 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PSI_SM_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace psi::sm {
+
+/**
+ * @brief TransitionTable describes reaction of table-driven machines on one event: state -> next state.
+ * By default every state stays unchanged.
+ *
+ * @tparam NumStates number of states, at most 256
+ */
+template <size_t NumStates>
+class TransitionTable
+{
+    static_assert(NumStates > 0 && NumStates <= 256, "State index must fit one byte");
+
+public:
+    TransitionTable()
+    {
+        for (size_t i = 0; i < NumStates; ++i) {
+            m_next[i] = static_cast<uint8_t>(i);
+        }
+    }
+
+    /// @brief Sets next state of machines being in state 'from'.
+    TransitionTable &set(uint8_t from, uint8_t to)
+    {
+        m_next[from] = to;
+        return *this;
+    }
+
+    /// @brief Returns next state of machines being in state 'from'.
+    uint8_t next(uint8_t from) const
+    {
+        return m_next[from];
+    }
+
+    /// @brief Returns table padded to 32 entries, used by vectorized kernels.
+    const uint8_t *data() const
+    {
+        return m_next.data();
+    }
+
+private:
+    std::array<uint8_t, (NumStates < 32 ? 32 : NumStates)> m_next {};
+};
+
+namespace detail {
+
+/**
+ * @brief Scalar kernel, used for tails of arrays, for more than 32 states and when SIMD is not available.
+ */
+inline size_t stepScalar(uint8_t *states, size_t begin, size_t end, const uint8_t *table, std::vector<uint32_t> *changed)
+{
+    size_t result = 0;
+    for (size_t i = begin; i < end; ++i) {
+        const uint8_t next = table[states[i]];
+        if (next != states[i]) {
+            states[i] = next;
+            ++result;
+            if (changed) {
+                changed->emplace_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+    return result;
+}
+
+#ifdef PSI_SM_X86_KERNELS
+
+/// @brief Collects indices of set bits of mask.
+inline void collectChanged(uint32_t mask, uint32_t base, std::vector<uint32_t> *changed)
+{
+    while (mask) {
+        changed->emplace_back(base + static_cast<uint32_t>(__builtin_ctz(mask)));
+        mask &= mask - 1;
+    }
+}
+
+/**
+ * @brief SSSE3 kernel for up to 32 states, 16 machines per iteration.
+ * Next states are looked up by byte shuffles of low and high halves of table.
+ */
+__attribute__((target("ssse3"))) inline size_t
+stepSsse3(uint8_t *states, size_t count, const uint8_t *table, bool wide, std::vector<uint32_t> *changed)
+{
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table + 16));
+    const __m128i fifteen = _mm_set1_epi8(15);
+
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto *p = reinterpret_cast<__m128i *>(states + i);
+        const __m128i cur = _mm_loadu_si128(p);
+        __m128i next = _mm_shuffle_epi8(lo, cur);
+        if (wide) {
+            const __m128i isHi = _mm_cmpgt_epi8(cur, fifteen);
+            const __m128i fromHi = _mm_shuffle_epi8(hi, _mm_and_si128(cur, fifteen));
+            next = _mm_or_si128(_mm_andnot_si128(isHi, next), _mm_and_si128(isHi, fromHi));
+        }
+
+        const auto mask = static_cast<uint32_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(cur, next)) & 0xFFFF);
+        if (mask) {
+            _mm_storeu_si128(p, next);
+            result += static_cast<size_t>(__builtin_popcount(mask));
+            if (changed) {
+                collectChanged(mask, static_cast<uint32_t>(i), changed);
+            }
+        }
+    }
+
+    return result + stepScalar(states, i, count, table, changed);
+}
+
+/**
+ * @brief AVX2 kernel for up to 32 states, 32 machines per iteration.
+ */
+__attribute__((target("avx2"))) inline size_t
+stepAvx2(uint8_t *states, size_t count, const uint8_t *table, bool wide, std::vector<uint32_t> *changed)
+{
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table + 16)));
+    const __m256i fifteen = _mm256_set1_epi8(15);
+
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        auto *p = reinterpret_cast<__m256i *>(states + i);
+        const __m256i cur = _mm256_loadu_si256(p);
+        __m256i next = _mm256_shuffle_epi8(lo, cur);
+        if (wide) {
+            const __m256i isHi = _mm256_cmpgt_epi8(cur, fifteen);
+            const __m256i fromHi = _mm256_shuffle_epi8(hi, _mm256_and_si256(cur, fifteen));
+            next = _mm256_blendv_epi8(next, fromHi, isHi);
+        }
+
+        const auto mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(cur, next)));
+        if (mask) {
+            _mm256_storeu_si256(p, next);
+            result += static_cast<size_t>(__builtin_popcount(mask));
+            if (changed) {
+                collectChanged(mask, static_cast<uint32_t>(i), changed);
+            }
+        }
+    }
+
+    return result + stepScalar(states, i, count, table, changed);
+}
+
+#endif
+
+} // namespace detail
+
+/// @brief Instruction set used by @batch_step.
+enum class StepKernel
+{
+    Scalar,
+    Ssse3,
+    Avx2,
+};
+
+/// @brief Returns best instruction set supported by CPU.
+inline StepKernel bestStepKernel()
+{
+#ifdef PSI_SM_X86_KERNELS
+    static const StepKernel kernel = __builtin_cpu_supports("avx2")    ? StepKernel::Avx2
+                                     : __builtin_cpu_supports("ssse3") ? StepKernel::Ssse3
+                                                                       : StepKernel::Scalar;
+    return kernel;
+#else
+    return StepKernel::Scalar;
+#endif
+}
+
+/**
+ * @brief Applies one table-driven event to packed array of state indices.
+ * Machines with up to 32 states are stepped by SIMD kernels if CPU supports them.
+ *
+ * @tparam NumStates number of states
+ * @param states state index of each machine (less than NumStates), updated in place
+ * @param count number of machines
+ * @param table transition table of event
+ * @param changed if not nullptr, indices of machines whose state is changed are appended in ascending order
+ * @param kernel instruction set to be used, must be supported by CPU
+ * @return size_t number of machines whose state is changed
+ */
+template <size_t NumStates>
+size_t batch_step(uint8_t *states,
+                  size_t count,
+                  const TransitionTable<NumStates> &table,
+                  std::vector<uint32_t> *changed = nullptr,
+                  StepKernel kernel = bestStepKernel())
+{
+#ifdef PSI_SM_X86_KERNELS
+    if constexpr (NumStates <= 32) {
+        const bool wide = NumStates > 16;
+        switch (kernel) {
+        case StepKernel::Avx2:
+            return detail::stepAvx2(states, count, table.data(), wide, changed);
+        case StepKernel::Ssse3:
+            return detail::stepSsse3(states, count, table.data(), wide, changed);
+        case StepKernel::Scalar:
+            break;
+        }
+    }
+#endif
+    (void)kernel;
+    return detail::stepScalar(states, 0, count, table.data(), changed);
+}
+
+} // namespace psi::sm
@@ -0,0 +1,767 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "BaseContext.h"
+#include "ResourceFunction.h"
+
+namespace psi::sm {
+
+template <typename Context, size_t Capacity>
+class ContextRoute;
+
+/**
+ * @brief BusyPollRunner is a dedicated thread owning group of contexts, optionally pinned to CPU.
+ * The concept is:
+ * - other threads pass events to owned contexts through bounded lock-free MPSC ingress ('send')
+ * - runner busy-polls ingress: spins, then yields, then parks on futex until producer wakes it up
+ * - runner holds locks of owned contexts while it runs, so processing of events does not perform
+ *   atomic operations; owned contexts must not be called directly by other threads
+ * - events are stored in ingress slots in place, big events should be wrapped into @SharedEvent<T>
+ * - contexts sent through @ContextRoute may be moved between running runners
+ *
+ * @tparam Capacity number of ingress slots, power of 2
+ */
+template <size_t Capacity = 1024>
+class BusyPollRunner
+{
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be power of 2");
+
+    static constexpr size_t CacheLine = 64;
+
+public:
+    /// @brief max size of event stored in ingress slot
+    static constexpr size_t MaxEventSize = 40;
+
+    struct Config {
+        /// @brief CPU to pin runner to, negative value means no pinning, failure is reported by 'pinError'
+        int cpu = -1;
+
+        /// @brief number of empty polls with CPU relax before yielding
+        uint32_t spins = 4096;
+
+        /// @brief number of empty polls with yield before parking
+        uint32_t yields = 64;
+
+        /// @brief max parking time, runner also wakes up on 'send'
+        std::chrono::microseconds park {1000};
+    };
+
+    explicit BusyPollRunner(Config config = {})
+        : m_config(config)
+    {
+        for (size_t i = 0; i < Capacity; ++i) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief Stops runner. Events sent after runner was stopped are destroyed without processing.
+    ~BusyPollRunner()
+    {
+        stop();
+
+        for (;;) {
+            Slot &slot = m_slots[m_tail & Mask];
+            if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) {
+                break;
+            }
+            slot.run(slot.storage, false);
+            slot.seq.store(m_tail + Capacity, std::memory_order_release);
+            ++m_tail;
+        }
+    }
+
+    /**
+     * @brief Passes ownership of context to runner. Must be called before 'start'.
+     * Context must outlive runner's thread.
+     *
+     * @tparam IState
+     * @param context context to be owned
+     */
+    template <typename IState>
+    void attach(BaseContext<IState> &context)
+    {
+        auto &mutex = context.mutex();
+        m_owned.emplace_back(&mutex, [](void *m) { static_cast<typename BaseContext<IState>::Mutex *>(m)->lock(); },
+                             [](void *m) { static_cast<typename BaseContext<IState>::Mutex *>(m)->unlock(); });
+    }
+
+    /**
+     * @brief Starts runner's thread. Returns once thread is pinned to CPU (see 'pinError').
+     *
+     * @return true if thread is started
+     * @return false if it is already running
+     */
+    bool start()
+    {
+        if (m_thread.joinable()) {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_controlMutex);
+            m_stop.store(false, std::memory_order_relaxed);
+        }
+        m_pinError.store(PinPending, std::memory_order_relaxed);
+        m_thread = std::thread([this]() { run(); });
+        while (m_pinError.load(std::memory_order_acquire) == PinPending) {
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    /// @brief Returns error code of pinning runner's thread to configured CPU, 0 if it is pinned or not configured.
+    int pinError() const
+    {
+        const int error = m_pinError.load(std::memory_order_acquire);
+        return error == PinPending ? 0 : error;
+    }
+
+    /// @brief Stops runner's thread. Events which are already sent are processed before thread exits.
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_controlMutex);
+            m_stop.store(true, std::memory_order_seq_cst);
+        }
+        wake();
+        m_thread.join();
+    }
+
+    /**
+     * @brief Sends event to owned context.
+     * Operation is thread-safe and lock-free.
+     *
+     * @tparam Context type of context
+     * @tparam T type of event
+     * @param context receiver, owned by runner
+     * @param ev event object
+     * @return true if event is sent
+     * @return false if ingress is full
+     */
+    template <typename Context, typename T>
+    bool try_send(Context &context, const T &ev)
+    {
+        return try_execute(Delivery<Context, T> {&context, ev});
+    }
+
+    /**
+     * @brief Sends event to owned context, waits while ingress is full.
+     * Operation is thread-safe.
+     *
+     * @tparam Context type of context
+     * @tparam T type of event
+     * @param context receiver, owned by runner
+     * @param ev event object
+     */
+    template <typename Context, typename T>
+    void send(Context &context, const T &ev)
+    {
+        while (!try_send(context, ev)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief Runs function in runner's thread, e.g. to read data of owned contexts.
+     * Operation is thread-safe and lock-free.
+     *
+     * @tparam Fn type of function 'void()'
+     * @param fn function object
+     * @return true if function is queued
+     * @return false if ingress is full
+     */
+    template <typename Fn>
+    bool try_execute(Fn &&fn)
+    {
+        using Task = std::decay_t<Fn>;
+        static_assert(sizeof(Task) <= sizeof(typename Slot::Storage), "Event is too big, wrap it into SharedEvent");
+        static_assert(alignof(Task) <= alignof(typename Slot::Storage), "Event is over-aligned");
+
+        uint64_t pos = m_head.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;) {
+            slot = &m_slots[pos & Mask];
+            const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<int64_t>(seq - pos);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        ::new (&slot->storage) Task(std::forward<Fn>(fn));
+        slot->run = &runTask<Task>;
+        slot->seq.store(pos + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed)) {
+            wake();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Runs function in runner's thread, waits while ingress is full.
+     * Operation is thread-safe.
+     *
+     * @tparam Fn type of function 'void()'
+     * @param fn function object
+     */
+    template <typename Fn>
+    void execute(Fn &&fn)
+    {
+        while (!try_execute(fn)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /// @brief Returns true if runner's thread is running.
+    bool running() const
+    {
+        return m_thread.joinable();
+    }
+
+    /// @brief Returns number of times runner parked on futex, useful to tune backoff.
+    uint64_t parks() const
+    {
+        return m_parks.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns number of processed events and tasks.
+    uint64_t processed() const
+    {
+        return m_processed.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns approximate number of events and tasks waiting in ingress.
+    uint64_t backlog() const
+    {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        const uint64_t processed = m_processed.load(std::memory_order_relaxed);
+        return head > processed ? head - processed : 0;
+    }
+
+private:
+    template <typename Context, size_t C>
+    friend class ContextRoute;
+
+    static constexpr uint64_t Mask = Capacity - 1;
+
+    template <typename Context, typename T>
+    struct Delivery {
+        Context *context;
+        T ev;
+
+        void operator()() const
+        {
+            context->process_event(ev);
+        }
+    };
+
+    struct alignas(CacheLine) Slot {
+        using Storage = std::aligned_storage_t<MaxEventSize + sizeof(void *), alignof(std::max_align_t)>;
+
+        std::atomic<uint64_t> seq {0};
+        /// @brief runs task if requested and destroys it
+        void (*run)(Storage &, bool) = nullptr;
+        Storage storage;
+    };
+
+    struct Owned {
+        Owned(void *m, void (*l)(void *), void (*u)(void *))
+            : mutex(m)
+            , lock(l)
+            , unlock(u)
+        {
+        }
+
+        void *mutex;
+        void (*lock)(void *);
+        void (*unlock)(void *);
+    };
+
+    template <typename Task>
+    static void runTask(typename Slot::Storage &storage, bool execute)
+    {
+        auto *task = std::launder(reinterpret_cast<Task *>(&storage));
+        if (execute) {
+            (*task)();
+        }
+        task->~Task();
+    }
+
+    /// @brief Locks mutex of context and keeps it until context is disowned or runner stops. Called by runner.
+    template <typename IState>
+    void own(BaseContext<IState> &context)
+    {
+        auto &mutex = context.mutex();
+        mutex.lock();
+        m_owned.emplace_back(&mutex, [](void *m) { static_cast<typename BaseContext<IState>::Mutex *>(m)->lock(); },
+                             [](void *m) { static_cast<typename BaseContext<IState>::Mutex *>(m)->unlock(); });
+    }
+
+    /// @brief Unlocks mutex of owned context. Called by runner.
+    template <typename IState>
+    void disown(BaseContext<IState> &context)
+    {
+        auto it = std::find_if(
+            m_owned.begin(), m_owned.end(), [&](const Owned &o) { return o.mutex == &context.mutex(); });
+        if (it != m_owned.end()) {
+            it->unlock(it->mutex);
+            m_owned.erase(it);
+        }
+    }
+
+    /**
+     * @brief Queues control task, e.g. handover of context from another runner. Called by other runners.
+     * Never waits for ingress: control tasks are kept in separate list, which runner checks on every poll.
+     *
+     * @return true if task is queued, it runs even if runner is being stopped
+     * @return false if runner is stopped, task is not queued
+     */
+    template <typename Fn>
+    bool schedule(Fn &&fn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_controlMutex);
+            if (m_stop.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            m_controls.emplace_back(std::forward<Fn>(fn));
+            m_hasControls.store(true, std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed)) {
+            wake();
+        }
+        return true;
+    }
+
+    /// @brief Runs queued control tasks. Returns number of tasks.
+    size_t runControls()
+    {
+        if (!m_hasControls.load(std::memory_order_acquire)) {
+            return 0;
+        }
+
+        std::vector<ResourceFunction<void()>> controls;
+        {
+            std::lock_guard<std::mutex> lock(m_controlMutex);
+            controls.swap(m_controls);
+            m_hasControls.store(false, std::memory_order_relaxed);
+        }
+        for (auto &fn : controls) {
+            fn();
+        }
+        return controls.size();
+    }
+
+    /// @brief Processes at most one batch of ingress. Returns number of processed tasks.
+    size_t poll()
+    {
+        size_t processed = 0;
+        for (;;) {
+            Slot &slot = m_slots[m_tail & Mask];
+            if (slot.seq.load(std::memory_order_acquire) != m_tail + 1) {
+                if (processed) {
+                    m_processed.store(m_tail, std::memory_order_relaxed);
+                }
+                return processed;
+            }
+
+            slot.run(slot.storage, true);
+            slot.seq.store(m_tail + Capacity, std::memory_order_release);
+            ++m_tail;
+            ++processed;
+        }
+    }
+
+    bool empty() const
+    {
+        return m_slots[m_tail & Mask].seq.load(std::memory_order_acquire) != m_tail + 1;
+    }
+
+    void run()
+    {
+        m_pinError.store(pin(), std::memory_order_release);
+        for (auto &o : m_owned) {
+            o.lock(o.mutex);
+        }
+
+        uint32_t idle = 0;
+        for (;;) {
+            if (poll() + runControls()) {
+                idle = 0;
+                continue;
+            }
+
+            if (m_stop.load(std::memory_order_acquire)) {
+                // producers may still be finishing their writes
+                if (m_head.load(std::memory_order_acquire) == m_tail) {
+                    // no control task is queued after stop
+                    runControls();
+                    break;
+                }
+                continue;
+            }
+
+            ++idle;
+            if (idle <= m_config.spins) {
+                relax();
+            } else if (idle <= m_config.spins + m_config.yields) {
+                std::this_thread::yield();
+            } else {
+                park();
+            }
+        }
+
+        for (auto &o : m_owned) {
+            o.unlock(o.mutex);
+        }
+    }
+
+    void park()
+    {
+        const uint32_t wakeups = m_wakeups.load(std::memory_order_acquire);
+        m_sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (empty() && !m_hasControls.load(std::memory_order_relaxed)
+            && !m_stop.load(std::memory_order_relaxed)) {
+            m_parks.fetch_add(1, std::memory_order_relaxed);
+            const auto secs = std::chrono::duration_cast<std::chrono::seconds>(m_config.park);
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(secs.count());
+            ts.tv_nsec = static_cast<long>(std::chrono::nanoseconds(m_config.park - secs).count());
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_wakeups), FUTEX_WAIT_PRIVATE, wakeups, &ts, nullptr, 0);
+        }
+
+        m_sleeping.store(0, std::memory_order_relaxed);
+    }
+
+    void wake()
+    {
+        m_wakeups.fetch_add(1, std::memory_order_release);
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_wakeups), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    /// @brief Pins runner's thread to configured CPU. Returns error code, 0 on success.
+    int pin()
+    {
+        if (m_config.cpu < 0) {
+            return 0;
+        }
+        if (m_config.cpu >= CPU_SETSIZE) {
+            return EINVAL;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(m_config.cpu, &set);
+        return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    }
+
+    static void relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    const Config m_config;
+    std::vector<Owned> m_owned;
+    std::thread m_thread;
+
+    /// @brief control tasks queued by other runners, not accepted once runner is stopped
+    std::mutex m_controlMutex;
+    std::vector<ResourceFunction<void()>> m_controls;
+    std::atomic<bool> m_hasControls {false};
+
+    /// @brief position of next slot to be claimed by producers
+    alignas(CacheLine) std::atomic<uint64_t> m_head {0};
+
+    /// @brief position of next slot to be processed, owned by runner's thread
+    alignas(CacheLine) uint64_t m_tail = 0;
+
+    /// @brief futex word, incremented by producers which wake runner
+    alignas(CacheLine) std::atomic<uint32_t> m_wakeups {0};
+    std::atomic<uint32_t> m_sleeping {0};
+    std::atomic<bool> m_stop {false};
+    std::atomic<uint64_t> m_parks {0};
+    std::atomic<uint64_t> m_processed {0};
+
+    static constexpr int PinPending = -1;
+    std::atomic<int> m_pinError {0};
+
+    std::unique_ptr<Slot[]> m_slots {new Slot[Capacity]};
+
+    BusyPollRunner(const BusyPollRunner &) = delete;
+    BusyPollRunner &operator=(const BusyPollRunner &) = delete;
+};
+
+/**
+ * @brief ContextRoute sends events to context owned by @BusyPollRunner and moves context between runners.
+ * The concept is:
+ * - producers send events through route, route forwards them into ingress of runner owning context
+ * - 'migrate' hands live context (its state, posted and deferred events) over to another runner without
+ *   stopping producers and without draining context
+ * - old runner releases context after it has processed all events sent to it; events reaching new runner
+ *   before that are kept aside and processed first once new runner takes context, so order of events
+ *   sent by each producer is preserved
+ * - 'processed' of route and 'processed'/'backlog' of runners let caller decide which contexts to move
+ *
+ * Route and context must outlive processing of events sent through route. Both runners must keep running
+ * while migration is in progress. Runners never wait for each other: handover bypasses ingress of new runner.
+ * If new runner is stopped before handover, migration is rolled back and context stays with old runner;
+ * events sent to stopped runner meanwhile are not processed.
+ *
+ * @tparam Context type of context
+ * @tparam Capacity capacity of runners
+ */
+template <typename Context, size_t Capacity = 1024>
+class ContextRoute
+{
+public:
+    using Runner = BusyPollRunner<Capacity>;
+
+    /**
+     * @brief Construct a new ContextRoute object and passes ownership of context to runner.
+     * Runner may be started later.
+     *
+     * @param context context to be owned, must not be called directly by other threads
+     * @param runner initial owner of context
+     */
+    ContextRoute(Context &context, Runner &runner)
+        : m_context(context)
+        , m_stash(context.memoryResource())
+        , m_runner(&runner)
+    {
+        m_migrating.store(true, std::memory_order_relaxed);
+        runner.execute(Adoption {this, &runner});
+    }
+
+    /**
+     * @brief Sends event to context.
+     * Operation is thread-safe and lock-free.
+     *
+     * @tparam T type of event
+     * @param ev event object
+     * @return true if event is sent
+     * @return false if ingress of runner is full
+     */
+    template <typename T>
+    bool try_send(const T &ev)
+    {
+        for (;;) {
+            const uint64_t epoch = m_epoch.load(std::memory_order_seq_cst);
+            auto &senders = m_senders[epoch & 1];
+            senders.fetch_add(1, std::memory_order_seq_cst);
+            if (m_epoch.load(std::memory_order_seq_cst) != epoch) {
+                // migration has started, runner of this epoch may be left
+                senders.fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+
+            const bool sent = m_runner.load(std::memory_order_seq_cst)->try_execute(Delivery<T> {this, ev});
+            senders.fetch_sub(1, std::memory_order_release);
+            return sent;
+        }
+    }
+
+    /**
+     * @brief Sends event to context, waits while ingress of runner is full.
+     * Operation is thread-safe.
+     *
+     * @tparam T type of event
+     * @param ev event object
+     */
+    template <typename T>
+    void send(const T &ev)
+    {
+        while (!try_send(ev)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief Moves context to another runner. Returns without waiting for handover,
+     * events sent after call are delivered to new runner.
+     * Operation is thread-safe.
+     *
+     * @param to new owner of context
+     * @return true if migration is started
+     * @return false if context is already owned by runner or previous migration is not finished
+     */
+    bool migrate(Runner &to)
+    {
+        std::lock_guard<std::mutex> lock(m_migrateMutex);
+        Runner *from = m_runner.load(std::memory_order_relaxed);
+        if (from == &to || m_migrating.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        m_migrating.store(true, std::memory_order_relaxed);
+        m_runner.store(&to, std::memory_order_seq_cst);
+        const uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst);
+
+        // producers which may have seen old runner finish their sends, so release follows their events
+        while (m_senders[epoch & 1].load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        from->execute(Release {this, from, &to});
+        return true;
+    }
+
+    /// @brief Returns true if context is being moved between runners.
+    bool migrating() const
+    {
+        return m_migrating.load(std::memory_order_acquire);
+    }
+
+    /// @brief Returns runner which receives events sent through route.
+    Runner &runner() const
+    {
+        return *m_runner.load(std::memory_order_acquire);
+    }
+
+    /// @brief Returns number of events processed by context, load metric of context.
+    uint64_t processed() const
+    {
+        return m_processed.load(std::memory_order_relaxed);
+    }
+
+    Context &context() const
+    {
+        return m_context;
+    }
+
+private:
+    template <typename T>
+    struct Delivery {
+        ContextRoute *route;
+        T ev;
+
+        void operator()() const
+        {
+            route->deliver(ev);
+        }
+    };
+
+    /// @brief Runs in old runner after events sent to it: unlocks context and lets new runner take it.
+    struct Release {
+        ContextRoute *route;
+        Runner *from;
+        Runner *to;
+
+        void operator()() const
+        {
+            from->disown(route->m_context);
+            // waiting for ingress of new runner could deadlock runners moving contexts to each other
+            if (!to->schedule(Adoption {route, to})) {
+                // new runner is stopped: context stays with old runner
+                from->own(route->m_context);
+                route->rollback(from);
+            }
+        }
+    };
+
+    /// @brief Runs in new runner: locks context and processes events kept aside.
+    struct Adoption {
+        ContextRoute *route;
+        Runner *to;
+
+        void operator()() const
+        {
+            to->own(route->m_context);
+            for (auto &fn : route->m_stash) {
+                fn();
+            }
+            route->m_stash.clear();
+            route->m_migrating.store(false, std::memory_order_release);
+        }
+    };
+
+    /// @brief Routes events back to old runner after failed handover. Called by old runner.
+    void rollback(Runner *from)
+    {
+        m_runner.store(from, std::memory_order_seq_cst);
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        m_migrating.store(false, std::memory_order_release);
+    }
+
+    /// @brief Called by runner which is owner of context or is going to be owner.
+    template <typename T>
+    void deliver(const T &ev)
+    {
+        if (!m_context.mutex().ownedByCurrentThread()) {
+            // previous owner has not released context yet
+            m_stash.emplace_back([this, ev]() { deliver(ev); }, m_context.memoryResource());
+            return;
+        }
+
+        m_processed.store(m_processed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_context.process_event(ev);
+    }
+
+    Context &m_context;
+
+    /// @brief events received by new runner before it owns context, accessed by new runner only
+    std::pmr::vector<ResourceFunction<void()>> m_stash;
+
+    std::atomic<Runner *> m_runner;
+    std::atomic<uint64_t> m_epoch {0};
+
+    /// @brief producers sending in progress, by parity of epoch
+    std::atomic<uint32_t> m_senders[2] = {};
+
+    std::atomic<bool> m_migrating {false};
+    std::atomic<uint64_t> m_processed {0};
+    std::mutex m_migrateMutex;
+
+    ContextRoute(const ContextRoute &) = delete;
+    ContextRoute &operator=(const ContextRoute &) = delete;
+};
+
+} // namespace psi::sm
+
+#endif
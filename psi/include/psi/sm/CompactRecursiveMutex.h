@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace psi::sm {
+
+/**
+ * @brief CompactRecursiveMutex is a recursive mutex of 16 bytes.
+ * Uncontended lock and unlock are single atomic operations, waiting threads sleep on futex (Linux)
+ * or yield (other platforms).
+ * Satisfies Lockable requirements, may be used with std::lock_guard and std::unique_lock.
+ */
+class CompactRecursiveMutex
+{
+public:
+    CompactRecursiveMutex() = default;
+
+    void lock()
+    {
+        const auto self = std::this_thread::get_id();
+        if (m_owner.load(std::memory_order_relaxed) == self) {
+            ++m_depth;
+            return;
+        }
+
+        uint32_t expected = Unlocked;
+        if (!m_state.compare_exchange_strong(expected, Locked, std::memory_order_acquire)) {
+            lockSlow();
+        }
+
+        m_owner.store(self, std::memory_order_relaxed);
+        m_depth = 1;
+    }
+
+    bool try_lock()
+    {
+        const auto self = std::this_thread::get_id();
+        if (m_owner.load(std::memory_order_relaxed) == self) {
+            ++m_depth;
+            return true;
+        }
+
+        uint32_t expected = Unlocked;
+        if (!m_state.compare_exchange_strong(expected, Locked, std::memory_order_acquire)) {
+            return false;
+        }
+
+        m_owner.store(self, std::memory_order_relaxed);
+        m_depth = 1;
+        return true;
+    }
+
+    void unlock()
+    {
+        if (--m_depth) {
+            return;
+        }
+
+        m_owner.store(std::thread::id(), std::memory_order_relaxed);
+        if (m_state.exchange(Unlocked, std::memory_order_release) == Contended) {
+            wake();
+        }
+    }
+
+    /// @brief Returns true if mutex is held by calling thread.
+    bool ownedByCurrentThread() const
+    {
+        return m_owner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+
+private:
+    static constexpr uint32_t Unlocked = 0;
+    static constexpr uint32_t Locked = 1;
+    static constexpr uint32_t Contended = 2;
+
+    void lockSlow()
+    {
+        for (int spin = 0; spin < 64; ++spin) {
+            std::this_thread::yield();
+            uint32_t expected = Unlocked;
+            if (m_state.load(std::memory_order_relaxed) == Unlocked
+                && m_state.compare_exchange_strong(expected, Locked, std::memory_order_acquire)) {
+                return;
+            }
+        }
+
+        while (m_state.exchange(Contended, std::memory_order_acquire) != Unlocked) {
+            wait();
+        }
+    }
+
+    void wait()
+    {
+#ifdef __linux__
+        ::syscall(
+            SYS_futex, reinterpret_cast<uint32_t *>(&m_state), FUTEX_WAIT_PRIVATE, Contended, nullptr, nullptr, 0);
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    void wake()
+    {
+#ifdef __linux__
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+    }
+
+    std::atomic<uint32_t> m_state {Unlocked};
+    uint32_t m_depth = 0;
+    std::atomic<std::thread::id> m_owner {};
+
+    CompactRecursiveMutex(const CompactRecursiveMutex &) = delete;
+    CompactRecursiveMutex &operator=(const CompactRecursiveMutex &) = delete;
+};
+
+} // namespace psi::sm
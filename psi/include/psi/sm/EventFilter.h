@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "StateId.h"
+
+namespace psi::sm {
+
+/**
+ * @brief EventList is a compile-time list of event types declared by state:
+ *      using HandledEvents = EventList<EvStart, EvStop>;  // other events are unconsumed without reaction
+ *      using DeferredEvents = EventList<EvData>;           // deferred without reaction
+ * Declarations replace reactions: 'react' of state is not called for events it does not handle or defers,
+ * so such overloads must not have side effects (e.g. default ones returning UnconsumedEvent / defer_event()).
+ *
+ * @tparam Ts types of events
+ */
+template <typename... Ts>
+struct EventList {
+};
+
+/**
+ * @brief EventFilter lets context decide on event without virtual call to state.
+ * The concept is:
+ * - state declaring 'HandledEvents' receives only listed events, others are unconsumed
+ * - state declaring 'DeferredEvents' never receives listed events, they are deferred
+ * - declarations of state are registered once, on first transition to it, into per-event bitsets of state ids
+ * - states which declare nothing (and states with id above MaxStates) receive all events as usual
+ * - declaring state must not rely on side effects of 'react' for events which are unconsumed or deferred
+ * - unhandled events sent to idle context are dropped without dispatching, busy context processes them in order
+ *
+ * @tparam IState state interface
+ */
+template <typename IState>
+class EventFilter
+{
+public:
+    /// @brief max number of state types of interface which may be filtered
+    static constexpr size_t MaxStates = 256;
+
+    enum class Verdict : uint8_t
+    {
+        React,
+        Unconsumed,
+        Defer,
+    };
+
+    /**
+     * @brief Registers event lists of state. Operation is thread-safe, registration is performed once.
+     *
+     * @tparam State type of state
+     */
+    template <typename State>
+    static void declare()
+    {
+        static const bool registered = registerState<State>();
+        (void)registered;
+    }
+
+    /**
+     * @brief Returns how event of type T must be handled by state.
+     *
+     * @tparam T type of event reacted by states
+     * @param id identifier of state
+     * @return Verdict React if state must react on event
+     */
+    template <typename T>
+    static Verdict verdict(StateId id)
+    {
+        if (id >= MaxStates) {
+            return Verdict::React;
+        }
+        if (s_deferred<T>.test(id)) {
+            return Verdict::Defer;
+        }
+        if (s_filtered.test(id) && !s_handled<T>.test(id)) {
+            return Verdict::Unconsumed;
+        }
+        return Verdict::React;
+    }
+
+private:
+    class Bits
+    {
+    public:
+        void set(StateId id)
+        {
+            m_words[id / 64].fetch_or(uint64_t(1) << (id % 64), std::memory_order_release);
+        }
+
+        bool test(StateId id) const
+        {
+            return m_words[id / 64].load(std::memory_order_acquire) & (uint64_t(1) << (id % 64));
+        }
+
+    private:
+        std::atomic<uint64_t> m_words[MaxStates / 64] = {};
+    };
+
+    template <typename State, typename = void>
+    struct HandledOf {
+        static constexpr bool declared = false;
+        using type = EventList<>;
+    };
+
+    template <typename State>
+    struct HandledOf<State, std::void_t<typename State::HandledEvents>> {
+        static constexpr bool declared = true;
+        using type = typename State::HandledEvents;
+    };
+
+    template <typename State, typename = void>
+    struct DeferredOf {
+        using type = EventList<>;
+    };
+
+    template <typename State>
+    struct DeferredOf<State, std::void_t<typename State::DeferredEvents>> {
+        using type = typename State::DeferredEvents;
+    };
+
+    template <typename... Ts>
+    static void setAll(EventList<Ts...>, [[maybe_unused]] StateId id, [[maybe_unused]] bool deferred)
+    {
+        ((deferred ? s_deferred<Ts> : s_handled<Ts>).set(id), ...);
+    }
+
+    template <typename State>
+    static bool registerState()
+    {
+        const StateId id = StateIds<IState>::template of<State>();
+        if (id >= MaxStates) {
+            return false;
+        }
+
+        setAll(typename HandledOf<State>::type {}, id, false);
+        setAll(typename DeferredOf<State>::type {}, id, true);
+        if (HandledOf<State>::declared) {
+            // published last: lists of state are complete once it is filtered
+            s_filtered.set(id);
+        }
+        return true;
+    }
+
+    /// @brief states declaring 'HandledEvents'
+    static inline Bits s_filtered;
+
+    /// @brief states handling event T
+    template <typename T>
+    static inline Bits s_handled;
+
+    /// @brief states deferring event T
+    template <typename T>
+    static inline Bits s_deferred;
+};
+
+} // namespace psi::sm
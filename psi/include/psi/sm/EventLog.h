@@ -0,0 +1,219 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace psi::sm {
+
+/**
+ * @brief EventLogHeader starts binary file of recorded events.
+ * File layout: header followed by 'count' records of 'recordSize' bytes each.
+ */
+struct EventLogHeader {
+    static constexpr char Magic[8] = {'P', 'S', 'I', 'S', 'M', 'L', 'O', 'G'};
+    static constexpr uint32_t Version = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+};
+
+/**
+ * @brief EventLogWriter appends recorded events to binary file.
+ * Number of records is written to header when writer is destroyed.
+ *
+ * @tparam T type of record, trivially copyable
+ */
+template <typename T>
+class EventLogWriter
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Record must be trivially copyable");
+
+public:
+    ~EventLogWriter()
+    {
+        EventLogHeader header = makeHeader();
+        std::fseek(m_file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, m_file);
+        std::fclose(m_file);
+    }
+
+    /**
+     * @brief Creates (or truncates) file of recorded events.
+     *
+     * @param path path to file
+     * @return std::unique_ptr<EventLogWriter> writer object, nullptr if file can not be created
+     */
+    static std::unique_ptr<EventLogWriter> create(const std::string &path)
+    {
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return nullptr;
+        }
+
+        std::unique_ptr<EventLogWriter> writer(new EventLogWriter(file));
+        EventLogHeader header = writer->makeHeader();
+        if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+            return nullptr;
+        }
+        return writer;
+    }
+
+    /**
+     * @brief Appends record to file.
+     *
+     * @param record record object
+     * @return true if record is written
+     */
+    bool append(const T &record)
+    {
+        if (std::fwrite(&record, sizeof(T), 1, m_file) != 1) {
+            return false;
+        }
+        ++m_count;
+        return true;
+    }
+
+    /// @brief Returns number of appended records.
+    uint64_t size() const
+    {
+        return m_count;
+    }
+
+private:
+    explicit EventLogWriter(std::FILE *file)
+        : m_file(file)
+    {
+    }
+
+    EventLogHeader makeHeader() const
+    {
+        EventLogHeader header;
+        std::memcpy(header.magic, EventLogHeader::Magic, sizeof(header.magic));
+        header.version = EventLogHeader::Version;
+        header.recordSize = sizeof(T);
+        header.count = m_count;
+        return header;
+    }
+
+    std::FILE *m_file;
+    uint64_t m_count = 0;
+
+    EventLogWriter(const EventLogWriter &) = delete;
+    EventLogWriter &operator=(const EventLogWriter &) = delete;
+};
+
+/**
+ * @brief EventLogReader maps file of recorded events into memory, records are read in place without copying.
+ *
+ * @tparam T type of record, must be the same as used by writer
+ */
+template <typename T>
+class EventLogReader
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Record must be trivially copyable");
+
+public:
+    ~EventLogReader()
+    {
+        ::munmap(m_mapping, m_mappingSize);
+    }
+
+    /**
+     * @brief Opens file of recorded events.
+     *
+     * @param path path to file
+     * @return std::unique_ptr<EventLogReader> reader object, nullptr if file does not exist or has other format
+     */
+    static std::unique_ptr<EventLogReader> open(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(EventLogHeader)) {
+            ::close(fd);
+            return nullptr;
+        }
+
+        const auto size = static_cast<size_t>(st.st_size);
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return nullptr;
+        }
+
+        const auto *header = static_cast<const EventLogHeader *>(mapping);
+        if (std::memcmp(header->magic, EventLogHeader::Magic, sizeof(header->magic)) != 0
+            || header->version != EventLogHeader::Version || header->recordSize != sizeof(T)
+            || header->count > (size - sizeof(EventLogHeader)) / sizeof(T)) {
+            ::munmap(mapping, size);
+            return nullptr;
+        }
+
+        ::madvise(mapping, size, MADV_WILLNEED);
+        return std::unique_ptr<EventLogReader>(new EventLogReader(mapping, size, header->count));
+    }
+
+    /// @brief Returns number of records.
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    /// @brief Returns pointer to first record.
+    const T *data() const
+    {
+        return reinterpret_cast<const T *>(static_cast<const char *>(m_mapping) + sizeof(EventLogHeader));
+    }
+
+    const T *begin() const
+    {
+        return data();
+    }
+
+    const T *end() const
+    {
+        return data() + m_count;
+    }
+
+    const T &operator[](size_t i) const
+    {
+        return data()[i];
+    }
+
+private:
+    static_assert(sizeof(EventLogHeader) % alignof(T) == 0, "Record is over-aligned");
+
+    EventLogReader(void *mapping, size_t mappingSize, size_t count)
+        : m_mapping(mapping)
+        , m_mappingSize(mappingSize)
+        , m_count(count)
+    {
+    }
+
+    void *m_mapping;
+    size_t m_mappingSize;
+    size_t m_count;
+
+    EventLogReader(const EventLogReader &) = delete;
+    EventLogReader &operator=(const EventLogReader &) = delete;
+};
+
+} // namespace psi::sm
+
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "SharedEvent.h"
+
+namespace psi::sm {
+
+/**
+ * @brief CancelToken is a shared flag cancelling all events which carry it.
+ * Default constructed token is empty and can not be cancelled.
+ */
+class CancelToken
+{
+public:
+    CancelToken() = default;
+
+    /// @brief Creates token which can be cancelled.
+    static CancelToken create()
+    {
+        CancelToken token;
+        token.m_flag = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+
+    /// @brief Cancels events carrying token. Operation is thread-safe.
+    void cancel() const
+    {
+        if (m_flag) {
+            m_flag->store(true, std::memory_order_release);
+        }
+    }
+
+    /// @brief Returns true if token is cancelled. Operation is thread-safe.
+    bool cancelled() const
+    {
+        return m_flag && m_flag->load(std::memory_order_acquire);
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_flag;
+};
+
+/**
+ * @brief ExpiringEvent is an event which is dropped by context without reaction once its deadline passed
+ * or its token is cancelled. States react on underlying event object as usual.
+ * Useful for deferred requests which become stale while waiting for a suitable state.
+ *
+ * @tparam T type of event, may be @SharedEvent<U>
+ */
+template <typename T>
+struct ExpiringEvent {
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief event object
+    T event;
+
+    /// @brief event is dropped after deadline
+    Clock::time_point deadline = Clock::time_point::max();
+
+    /// @brief event is dropped once token is cancelled
+    CancelToken token;
+};
+
+/**
+ * @brief IsExpiring tells whether events of type T may expire while they are queued.
+ *
+ * @tparam T type of event
+ */
+template <typename T>
+struct IsExpiring : std::false_type {
+};
+
+template <typename T>
+struct IsExpiring<ExpiringEvent<T>> : std::true_type {
+};
+
+/**
+ * @brief Creates event expiring after specified time.
+ *
+ * @tparam T type of event
+ * @param ev event object
+ * @param ttl time to live of event
+ * @param token cancellation token, empty by default
+ * @return ExpiringEvent<T> expiring event object
+ */
+template <typename T, typename Rep, typename Period>
+ExpiringEvent<T> make_expiring_event(T ev, std::chrono::duration<Rep, Period> ttl, CancelToken token = {})
+{
+    return ExpiringEvent<T> {std::move(ev),
+                             ExpiringEvent<T>::Clock::now()
+                                 + std::chrono::duration_cast<typename ExpiringEvent<T>::Clock::duration>(ttl),
+                             std::move(token)};
+}
+
+/**
+ * @brief Creates event which lives until token is cancelled.
+ *
+ * @tparam T type of event
+ * @param ev event object
+ * @param token cancellation token
+ * @return ExpiringEvent<T> expiring event object
+ */
+template <typename T>
+ExpiringEvent<T> make_cancellable_event(T ev, CancelToken token)
+{
+    return ExpiringEvent<T> {std::move(ev), ExpiringEvent<T>::Clock::time_point::max(), std::move(token)};
+}
+
+/**
+ * @brief Returns object to be reacted by state.
+ *
+ * @tparam T type of event
+ * @param ev expiring event object
+ * @return underlying event object
+ */
+template <typename T>
+decltype(auto) event_ref(const ExpiringEvent<T> &ev)
+{
+    return event_ref(ev.event);
+}
+
+/**
+ * @brief Returns true if event must be dropped without reaction.
+ *
+ * @tparam T type of event
+ * @return false, plain events never expire
+ */
+template <typename T>
+constexpr bool is_expired(const T &)
+{
+    return false;
+}
+
+/**
+ * @brief Returns true if event must be dropped without reaction.
+ * Clock is read only if event has a deadline.
+ *
+ * @tparam T type of event
+ * @param ev expiring event object
+ * @return true if token is cancelled or deadline passed
+ */
+template <typename T>
+bool is_expired(const ExpiringEvent<T> &ev)
+{
+    using Clock = typename ExpiringEvent<T>::Clock;
+    return ev.token.cancelled() || (ev.deadline != Clock::time_point::max() && Clock::now() >= ev.deadline);
+}
+
+} // namespace psi::sm
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BatchStep.h"
+#include "ProcessResult.h"
+
+namespace psi::sm {
+
+/// @brief List of state types of @FlyweightEngine. First state is initial one.
+template <typename... States>
+struct StateList {
+};
+
+template <typename StateListT, typename... Columns>
+class FlyweightEngine;
+
+/**
+ * @brief FlyweightEngine runs huge number of tiny state machines sharing behaviour of state types.
+ * The concept is:
+ * - machine is an index of its state plus user data, stored as structure of arrays (one vector per column)
+ * - state types have no objects, they provide static reactions:
+ *      static ProcessResult react(Machine &machine, const EvExample &event);
+ *   missing reaction means UnconsumedEvent
+ * - events are applied to machine by its id, dispatch is one indirect call through table shared by all machines
+ * - machines have no queues: deferring or posting is reported to caller as result of 'process_event'
+ * - transitions only change state index, reaction performs them by 'machine.transit<NextState>()'
+ * Not thread-safe, owner is responsible for synchronization.
+ *
+ * @tparam States state types
+ * @tparam Columns types of user data columns
+ */
+template <typename... States, typename... Columns>
+class FlyweightEngine<StateList<States...>, Columns...>
+{
+    static_assert(sizeof...(States) > 0, "At least one state is required");
+    static_assert(sizeof...(States) <= 256, "State index must fit one byte");
+
+public:
+    using MachineId = uint32_t;
+    using StateIndex = uint8_t;
+
+    /// @brief Memory used by one machine, bytes.
+    static constexpr size_t BytesPerMachine = (sizeof(StateIndex) + ... + sizeof(Columns));
+
+    /**
+     * @brief Machine is a lightweight handle to machine passed to reactions of states.
+     */
+    class Machine
+    {
+    public:
+        /// @brief Returns id of machine.
+        MachineId id() const
+        {
+            return m_id;
+        }
+
+        /// @brief Returns column of machine's data.
+        template <size_t Column>
+        auto &get()
+        {
+            return m_engine.template column<Column>(m_id);
+        }
+
+        /// @brief Returns true if machine is in specified state.
+        template <typename State>
+        bool is() const
+        {
+            return m_engine.state(m_id) == stateIndex<State>();
+        }
+
+        /**
+         * @brief Performs transition of machine to new state.
+         *
+         * @tparam NextState type of new state
+         * @return ProcessResult TransitState
+         */
+        template <typename NextState>
+        ProcessResult transit()
+        {
+            m_engine.m_states[m_id] = stateIndex<NextState>();
+            return ProcessResult::TransitState;
+        }
+
+    private:
+        friend class FlyweightEngine;
+
+        Machine(FlyweightEngine &engine, MachineId id)
+            : m_engine(engine)
+            , m_id(id)
+        {
+        }
+
+        FlyweightEngine &m_engine;
+        const MachineId m_id;
+    };
+
+    /// @brief Returns index of state type.
+    template <typename State>
+    static constexpr StateIndex stateIndex()
+    {
+        static_assert((std::is_same_v<State, States> || ...), "State is not in list");
+
+        constexpr bool matches[] = {std::is_same_v<State, States>...};
+        StateIndex i = 0;
+        while (!matches[i]) {
+            ++i;
+        }
+        return i;
+    }
+
+    /// @brief Reserves memory for specified number of machines.
+    void reserve(size_t machines)
+    {
+        m_states.reserve(machines);
+        std::apply([&](auto &...cols) { (cols.reserve(machines), ...); }, m_columns);
+    }
+
+    /// @brief Returns number of machines.
+    size_t size() const
+    {
+        return m_states.size();
+    }
+
+    /**
+     * @brief Creates machine in initial state.
+     *
+     * @param values initial values of data columns
+     * @return MachineId id of new machine
+     */
+    MachineId create(Columns... values)
+    {
+        return create<std::tuple_element_t<0, std::tuple<States...>>>(std::move(values)...);
+    }
+
+    /**
+     * @brief Creates machine in specified state.
+     *
+     * @tparam State type of initial state
+     * @param values initial values of data columns
+     * @return MachineId id of new machine
+     */
+    template <typename State>
+    MachineId create(Columns... values)
+    {
+        const auto id = static_cast<MachineId>(m_states.size());
+        m_states.emplace_back(stateIndex<State>());
+        createColumns(std::index_sequence_for<Columns...> {}, std::move(values)...);
+        return id;
+    }
+
+    /// @brief Returns index of machine's state.
+    StateIndex state(MachineId id) const
+    {
+        return m_states[id];
+    }
+
+    /// @brief Returns state indices of all machines.
+    const std::vector<StateIndex> &states() const
+    {
+        return m_states;
+    }
+
+    /// @brief Returns value of machine's data column.
+    template <size_t Column>
+    auto &column(MachineId id)
+    {
+        return std::get<Column>(m_columns)[id];
+    }
+
+    /// @brief Returns whole data column.
+    template <size_t Column>
+    auto &column()
+    {
+        return std::get<Column>(m_columns);
+    }
+
+    /**
+     * @brief Processes event by machine in accordance with its state.
+     *
+     * @tparam T type of event
+     * @param id id of machine
+     * @param ev event object
+     * @return ProcessResult result of state's reaction
+     */
+    template <typename T>
+    ProcessResult process_event(MachineId id, const T &ev)
+    {
+        Machine machine(*this, id);
+        return ReactTable<T>::table[m_states[id]](machine, ev);
+    }
+
+    /**
+     * @brief Processes event by all machines in order of their ids.
+     *
+     * @tparam T type of event
+     * @param ev event object
+     * @return size_t number of machines which consumed event (any result except UnconsumedEvent)
+     */
+    template <typename T>
+    size_t process_event_all(const T &ev)
+    {
+        size_t consumed = 0;
+        const auto size = static_cast<MachineId>(m_states.size());
+        for (MachineId id = 0; id < size; ++id) {
+            consumed += process_event(id, ev) != ProcessResult::UnconsumedEvent;
+        }
+        return consumed;
+    }
+
+    /**
+     * @brief Applies table-driven event to all machines at once, states' reactions are not called.
+     * Useful for events which only change state of many machines, reactions may then be run for changed ones.
+     *
+     * @param table transition table of event, built from 'stateIndex<State>()'
+     * @param changed if not nullptr, ids of machines whose state is changed are appended in ascending order
+     * @return size_t number of machines whose state is changed
+     */
+    size_t step_all(const TransitionTable<sizeof...(States)> &table, std::vector<MachineId> *changed = nullptr)
+    {
+        return batch_step(m_states.data(), m_states.size(), table, changed);
+    }
+
+    /// @brief Returns number of machines in specified state.
+    template <typename State>
+    size_t count() const
+    {
+        size_t result = 0;
+        for (const auto st : m_states) {
+            result += st == stateIndex<State>();
+        }
+        return result;
+    }
+
+private:
+    template <size_t... I>
+    void createColumns(std::index_sequence<I...>, Columns... values)
+    {
+        (std::get<I>(m_columns).emplace_back(std::move(values)), ...);
+    }
+
+    template <typename State, typename T, typename = void>
+    struct HasReaction : std::false_type {
+    };
+
+    template <typename State, typename T>
+    struct HasReaction<State, T, std::void_t<decltype(State::react(std::declval<Machine &>(), std::declval<const T &>()))>>
+        : std::true_type {
+    };
+
+    template <typename T>
+    struct ReactTable {
+        using Fn = ProcessResult (*)(Machine &, const T &);
+
+        template <typename State>
+        static ProcessResult react(Machine &machine, const T &ev)
+        {
+            if constexpr (HasReaction<State, T>::value) {
+                return State::react(machine, ev);
+            } else {
+                (void)machine;
+                (void)ev;
+                return ProcessResult::UnconsumedEvent;
+            }
+        }
+
+        static constexpr Fn table[] = {&react<States>...};
+    };
+
+    /// @brief state index of each machine
+    std::vector<StateIndex> m_states;
+
+    /// @brief user data, one vector per column
+    std::tuple<std::vector<Columns>...> m_columns;
+};
+
+} // namespace psi::sm
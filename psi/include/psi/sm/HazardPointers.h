@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+
+namespace psi::sm {
+
+/**
+ * @brief HazardDomain protects objects read without locks from being destroyed by their owner.
+ * The concept is:
+ * - reader announces pointer in its thread's hazard slot and re-reads source to confirm it is still published
+ * - owner replaces published pointer, then checks whether old object is announced by any reader
+ * - announced object is kept by owner and destroyed later, otherwise it is destroyed at once
+ * Each thread claims a record with few hazard slots on first use, record is returned on thread exit.
+ * Records are added when all existing ones are claimed and are reused afterwards, so number of threads is
+ * not limited; owners scan all records ever added.
+ */
+class HazardDomain
+{
+public:
+    /// @brief max number of nested guards per thread
+    static constexpr size_t SlotsPerRecord = 4;
+
+    /// @brief Returns process-wide domain.
+    static HazardDomain &instance()
+    {
+        static HazardDomain domain;
+        return domain;
+    }
+
+    /**
+     * @brief Guard holds one hazard slot of current thread while it exists.
+     * Throws std::length_error if more than SlotsPerRecord guards are nested in thread.
+     */
+    class Guard
+    {
+    public:
+        Guard()
+            : m_slot(threadRecord().acquire())
+        {
+        }
+
+        ~Guard()
+        {
+            m_slot->store(nullptr, std::memory_order_release);
+            threadRecord().release();
+        }
+
+        /**
+         * @brief Reads published pointer and protects object from destruction until guard is destroyed.
+         *
+         * @tparam T type of object
+         * @param src published pointer
+         * @return T* protected pointer, may be nullptr
+         */
+        template <typename T>
+        T *protect(const std::atomic<T *> &src)
+        {
+            T *p = src.load(std::memory_order_relaxed);
+            for (;;) {
+                m_slot->store(p, std::memory_order_seq_cst);
+                T *q = src.load(std::memory_order_seq_cst);
+                if (q == p) {
+                    return p;
+                }
+                p = q;
+            }
+        }
+
+    private:
+        std::atomic<const void *> *m_slot;
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    /**
+     * @brief Checks whether object is protected by any reader.
+     * Owner must unpublish object before the check (with sequentially consistent store).
+     *
+     * @param p object
+     * @return true if object must not be destroyed yet
+     */
+    bool isProtected(const void *p) const
+    {
+        for (const Record *r = m_records.load(std::memory_order_seq_cst); r; r = r->next) {
+            for (const auto &slot : r->slots) {
+                if (slot.load(std::memory_order_seq_cst) == p) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    struct alignas(64) Record {
+        std::atomic<bool> claimed {false};
+        std::array<std::atomic<const void *>, SlotsPerRecord> slots {};
+        Record *next = nullptr;
+    };
+
+    /// @brief Record of thread, claimed on first guard and returned to domain on thread exit.
+    class ThreadRecord
+    {
+    public:
+        ~ThreadRecord()
+        {
+            if (m_record) {
+                m_record->claimed.store(false, std::memory_order_release);
+            }
+        }
+
+        std::atomic<const void *> *acquire()
+        {
+            if (!m_record) {
+                m_record = instance().claim();
+            }
+            if (m_depth == SlotsPerRecord) {
+                throw std::length_error("Too many nested hazard guards");
+            }
+            return &m_record->slots[m_depth++];
+        }
+
+        void release()
+        {
+            --m_depth;
+        }
+
+    private:
+        Record *m_record = nullptr;
+        size_t m_depth = 0;
+    };
+
+    static ThreadRecord &threadRecord()
+    {
+        static thread_local ThreadRecord record;
+        return record;
+    }
+
+    Record *claim()
+    {
+        for (Record *r = m_records.load(std::memory_order_acquire); r; r = r->next) {
+            bool expected = false;
+            if (!r->claimed.load(std::memory_order_relaxed)
+                && r->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return r;
+            }
+        }
+
+        auto *r = new Record;
+        r->claimed.store(true, std::memory_order_relaxed);
+        r->next = m_records.load(std::memory_order_relaxed);
+        while (!m_records.compare_exchange_weak(r->next, r, std::memory_order_seq_cst)) {
+        }
+        return r;
+    }
+
+    HazardDomain() = default;
+
+    /// @brief list of records, records are never freed: threads may return them while process exits
+    std::atomic<Record *> m_records {nullptr};
+};
+
+} // namespace psi::sm
@@ -17,34 +17,32 @@ enum class ProcessResult
     TransitState,       /// returned if new state is created by context
 };
 
-inline std::ostream &operator<<(std::ostream &os, const ProcessResult &rs)
+inline const char *to_string(const ProcessResult &rs)
 {
-    os << "ProcessResult::";
-
     switch (rs) {
     case ProcessResult::UnknownContext:
-        os << "UnknownContext";
-        break;
+        return "UnknownContext";
     case ProcessResult::UnknownState:
-        os << "UnknownState";
-        break;
+        return "UnknownState";
     case ProcessResult::UnconsumedEvent:
-        os << "UnconsumedEvent";
-        break;
+        return "UnconsumedEvent";
     case ProcessResult::DeferredEvent:
-        os << "DeferredEvent";
-        break;
+        return "DeferredEvent";
     case ProcessResult::DiscardedEvent:
-        os << "DiscardedEvent";
-        break;
+        return "DiscardedEvent";
     case ProcessResult::PostedEvent:
-        os << "PostedEvent";
-        break;
+        return "PostedEvent";
     case ProcessResult::TransitState:
-        os << "TransitState";
-        break;
+        return "TransitState";
     }
 
+    return "";
+}
+
+inline std::ostream &operator<<(std::ostream &os, const ProcessResult &rs)
+{
+    os << "ProcessResult::" << to_string(rs);
+
     os << std::endl;
 
     return os;
@@ -0,0 +1,653 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <typeinfo>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUG__)
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace psi::sm::watchdog {
+
+/// @brief Small id of state or event type, assigned once per type on its first reaction.
+using TypeId = uint32_t;
+
+/// @brief id of type which exceeded limits below, its reactions are reported but not profiled
+static constexpr TypeId InvalidId = UINT32_MAX;
+
+/// @brief max number of profiled state types
+static constexpr size_t MaxStates = 256;
+
+/// @brief max number of profiled event types
+static constexpr size_t MaxEvents = 256;
+
+/// @brief Returns current timestamp counter: TSC on x86, nanoseconds elsewhere.
+inline uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+}
+
+/// @brief Returns number of ticks per nanosecond, calibrated once (takes ~20 ms on first call).
+inline double ticksPerNs()
+{
+    static const double value = []() {
+#if defined(__x86_64__) || defined(__i386__)
+        const auto begin = std::chrono::steady_clock::now();
+        const uint64_t t0 = ticks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const uint64_t t1 = ticks();
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+        return static_cast<double>(t1 - t0) / static_cast<double>(ns.count());
+#else
+        return 1.0;
+#endif
+    }();
+    return value;
+}
+
+/**
+ * @brief Histogram of reaction durations with log2 buckets of ticks.
+ * Written by single thread, may be read concurrently.
+ */
+class Histogram
+{
+public:
+    static constexpr size_t Buckets = 48;
+
+    void add(uint64_t duration)
+    {
+        const size_t bucket = duration ? std::min<size_t>(64 - __builtin_clzll(duration), Buckets - 1) : 0;
+        bump(m_buckets[bucket], 1);
+        bump(m_count, 1);
+        bump(m_sum, duration);
+        if (duration > m_max.load(std::memory_order_relaxed)) {
+            m_max.store(duration, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t sum() const
+    {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns number of durations in [2^(bucket-1), 2^bucket) ticks.
+    uint64_t bucket(size_t i) const
+    {
+        return m_buckets[i].load(std::memory_order_relaxed);
+    }
+
+private:
+    /// @brief single writer: plain load and store, no locked instruction
+    static void bump(std::atomic<uint64_t> &value, uint64_t delta)
+    {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, Buckets> m_buckets {};
+    std::atomic<uint64_t> m_count {0};
+    std::atomic<uint64_t> m_sum {0};
+    std::atomic<uint64_t> m_max {0};
+};
+
+/// @brief Reaction running longer than budget.
+struct SlowReaction {
+    const void *context;
+    std::string state;
+    std::string event;
+    std::chrono::nanoseconds elapsed;
+};
+
+/// @brief Aggregated latencies of one (state, event) pair.
+struct LatencyStats {
+    std::string state;
+    std::string event;
+    uint64_t count = 0;
+    std::chrono::nanoseconds mean {0};
+    std::chrono::nanoseconds p50 {0};
+    std::chrono::nanoseconds p99 {0};
+    std::chrono::nanoseconds max {0};
+};
+
+namespace detail {
+
+inline std::string demangle(const char *name)
+{
+    std::string result = name ? name : "<none>";
+#if defined(__GNUG__)
+    int status = 0;
+    char *demangled = name ? abi::__cxa_demangle(name, nullptr, nullptr, &status) : nullptr;
+    if (status == 0 && demangled) {
+        result = demangled;
+    }
+    std::free(demangled);
+#endif
+    return result;
+}
+
+/// @brief Names of types by their ids. Ids are never reused.
+template <size_t Max>
+class TypeNames
+{
+public:
+    TypeId add(const char *name)
+    {
+        const TypeId id = m_count.fetch_add(1, std::memory_order_relaxed);
+        if (id >= Max) {
+            return InvalidId;
+        }
+        m_names[id].store(name, std::memory_order_release);
+        return id;
+    }
+
+    const char *name(TypeId id) const
+    {
+        return id < Max ? m_names[id].load(std::memory_order_acquire) : nullptr;
+    }
+
+private:
+    std::atomic<TypeId> m_count {0};
+    std::array<std::atomic<const char *>, Max> m_names {};
+};
+
+inline TypeNames<MaxStates> &stateNames()
+{
+    static TypeNames<MaxStates> names;
+    return names;
+}
+
+inline TypeNames<MaxEvents> &eventNames()
+{
+    static TypeNames<MaxEvents> names;
+    return names;
+}
+
+/// @brief Latencies of one (state, event) pair merged from histograms.
+struct Aggregate {
+    TypeId state;
+    TypeId event;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, Histogram::Buckets> buckets {};
+
+    void add(const Histogram &h)
+    {
+        count += h.count();
+        sum += h.sum();
+        max = std::max(max, h.max());
+        for (size_t i = 0; i < Histogram::Buckets; ++i) {
+            buckets[i] += h.bucket(i);
+        }
+    }
+};
+
+/// @brief Returns aggregate of pair, adds it if it does not exist.
+inline Aggregate &aggregateOf(std::vector<Aggregate> &aggregates, TypeId st, TypeId ev)
+{
+    auto it = std::find_if(
+        aggregates.begin(), aggregates.end(), [&](const Aggregate &a) { return a.state == st && a.event == ev; });
+    if (it == aggregates.end()) {
+        it = aggregates.insert(aggregates.end(), Aggregate {st, ev});
+    }
+    return *it;
+}
+
+/**
+ * @brief ThreadData holds reaction currently run by thread and histograms of reactions run by thread.
+ * Written by owning thread only. Histograms are indexed by ids of state and event, rows of table are
+ * allocated on first reaction of state and are kept until thread data is destroyed.
+ */
+class ThreadData
+{
+public:
+    using Row = std::array<std::atomic<Histogram *>, MaxEvents>;
+    using Rows = std::array<std::atomic<Row *>, MaxStates>;
+
+    ThreadData() = default;
+
+    ~ThreadData()
+    {
+        Rows *rows = m_rows.load(std::memory_order_relaxed);
+        if (!rows) {
+            return;
+        }
+        for (auto &row : *rows) {
+            if (Row *r = row.load(std::memory_order_relaxed)) {
+                for (auto &h : *r) {
+                    delete h.load(std::memory_order_relaxed);
+                }
+                delete r;
+            }
+        }
+        delete rows;
+    }
+
+    /// @brief start of current reaction, 0 if thread does not react
+    std::atomic<uint64_t> start {0};
+    std::atomic<const void *> context {nullptr};
+    std::atomic<TypeId> state {InvalidId};
+    std::atomic<TypeId> event {InvalidId};
+
+    /// @brief Stores reaction into slot. Slot is marked idle while it is updated, so monitor skips torn reads.
+    void publish(uint64_t startTicks, const void *ctx, TypeId st, TypeId ev)
+    {
+        start.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        context.store(ctx, std::memory_order_relaxed);
+        state.store(st, std::memory_order_relaxed);
+        event.store(ev, std::memory_order_relaxed);
+        start.store(startTicks, std::memory_order_release);
+    }
+
+    /// @brief start of last reaction reported as slow, accessed by monitor only
+    uint64_t reported = 0;
+
+    /// @brief Returns histogram of pair, nullptr if type is not profiled.
+    Histogram *histogram(TypeId st, TypeId ev)
+    {
+        if (st < MaxStates && ev < MaxEvents) {
+            if (Rows *rows = m_rows.load(std::memory_order_relaxed)) {
+                if (Row *row = (*rows)[st].load(std::memory_order_relaxed)) {
+                    if (Histogram *h = (*row)[ev].load(std::memory_order_relaxed)) {
+                        return h;
+                    }
+                }
+            }
+        }
+        return add(st, ev);
+    }
+
+    /// @brief Calls function with every histogram. Operation is thread-safe.
+    template <typename Fn>
+    void forEach(Fn &&fn) const
+    {
+        const Rows *rows = m_rows.load(std::memory_order_acquire);
+        if (!rows) {
+            return;
+        }
+        for (TypeId st = 0; st < MaxStates; ++st) {
+            const Row *row = (*rows)[st].load(std::memory_order_acquire);
+            if (!row) {
+                continue;
+            }
+            for (TypeId ev = 0; ev < MaxEvents; ++ev) {
+                if (const Histogram *h = (*row)[ev].load(std::memory_order_acquire)) {
+                    fn(st, ev, *h);
+                }
+            }
+        }
+    }
+
+private:
+    /// @brief Allocates histogram on first reaction of pair. Allocations are published after construction.
+    Histogram *add(TypeId st, TypeId ev)
+    {
+        if (st >= MaxStates || ev >= MaxEvents) {
+            return nullptr;
+        }
+
+        Rows *rows = m_rows.load(std::memory_order_relaxed);
+        if (!rows) {
+            rows = new Rows {};
+            m_rows.store(rows, std::memory_order_release);
+        }
+        Row *row = (*rows)[st].load(std::memory_order_relaxed);
+        if (!row) {
+            row = new Row {};
+            (*rows)[st].store(row, std::memory_order_release);
+        }
+        auto *h = new Histogram;
+        (*row)[ev].store(h, std::memory_order_release);
+        return h;
+    }
+
+    std::atomic<Rows *> m_rows {nullptr};
+
+    ThreadData(const ThreadData &) = delete;
+    ThreadData &operator=(const ThreadData &) = delete;
+};
+
+} // namespace detail
+
+/// @brief Returns id of state type. Type name is resolved once per type.
+template <typename State>
+TypeId stateId()
+{
+    static const TypeId id = detail::stateNames().add(typeid(State).name());
+    return id;
+}
+
+/// @brief Returns id of event type. Type name is resolved once per type.
+template <typename T>
+TypeId eventId()
+{
+    static const TypeId id = detail::eventNames().add(typeid(T).name());
+    return id;
+}
+
+/**
+ * @brief Watchdog flags slow reactions of states and profiles latencies of reactions.
+ * The concept is:
+ * - hooks of @BaseContext are compiled only if PSI_SM_WATCHDOG is defined for whole build (CMake option
+ *   PSI_SM_WATCHDOG), defining it in some translation units only is not supported; watchdog requires RTTI
+ * - state and event types get small ids once per type, reaction does not look up or hash type names
+ * - beginning of reaction stores TSC timestamp, context, state and event ids into slot of calling thread
+ * - end of reaction clears slot and adds duration to per-(state, event) histogram of calling thread,
+ *   histogram is found by ids directly
+ * - monitor thread ('start') scans slots periodically and reports reactions running longer than budget
+ * - 'latencies' merges histograms of all threads, histograms of exited threads are merged once on exit
+ */
+class Watchdog
+{
+public:
+    using Callback = std::function<void(const SlowReaction &)>;
+
+    static Watchdog &instance()
+    {
+        static Watchdog watchdog;
+        return watchdog;
+    }
+
+    ~Watchdog()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Starts monitor thread.
+     *
+     * @param budget max expected duration of reaction
+     * @param period period of checking running reactions
+     * @param callback called by monitor thread once per slow reaction, prints to std::cerr by default
+     */
+    void start(std::chrono::nanoseconds budget,
+               std::chrono::milliseconds period = std::chrono::milliseconds(10),
+               Callback callback = {})
+    {
+        stop();
+
+        const auto budgetTicks = static_cast<uint64_t>(static_cast<double>(budget.count()) * ticksPerNs());
+        m_callback = callback ? std::move(callback) : [](const SlowReaction &slow) {
+            std::cerr << "[watchdog] slow reaction of " << slow.state << " on " << slow.event << " in context "
+                      << slow.context << ": " << slow.elapsed.count() << " ns" << std::endl;
+        };
+
+        std::lock_guard<std::mutex> lock(m_monitorMutex);
+        m_stopping = false;
+        m_monitor = std::thread([this, budgetTicks, period]() {
+            std::unique_lock<std::mutex> lock(m_monitorMutex);
+            while (!m_stopping) {
+                m_monitorCv.wait_for(lock, period);
+                check(budgetTicks);
+            }
+        });
+    }
+
+    /// @brief Stops monitor thread. Histograms are kept.
+    void stop()
+    {
+        if (!m_monitor.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_monitorMutex);
+            m_stopping = true;
+        }
+        m_monitorCv.notify_one();
+        m_monitor.join();
+    }
+
+    /// @brief Returns number of reported slow reactions.
+    uint64_t slowReactions() const
+    {
+        return m_slow.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns latencies of reactions merged from all threads, sorted by descending max.
+    std::vector<LatencyStats> latencies()
+    {
+        std::vector<detail::Aggregate> merged;
+        {
+            std::lock_guard<std::mutex> lock(m_threadsMutex);
+            merged = m_retired;
+            for (const auto &data : m_threads) {
+                data->forEach([&](TypeId st, TypeId ev, const Histogram &h) {
+                    detail::aggregateOf(merged, st, ev).add(h);
+                });
+            }
+        }
+
+        const double perNs = ticksPerNs();
+        const auto toNs = [perNs](uint64_t t) {
+            return std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(t) / perNs));
+        };
+        // upper bound of bucket containing given share of durations
+        const auto percentile = [](const detail::Aggregate &m, double p) {
+            const auto rank = static_cast<uint64_t>(p * static_cast<double>(m.count));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < Histogram::Buckets; ++i) {
+                seen += m.buckets[i];
+                if (seen > rank) {
+                    return std::min<uint64_t>(i ? (uint64_t(1) << i) - 1 : 0, m.max);
+                }
+            }
+            return m.max;
+        };
+
+        std::vector<LatencyStats> result;
+        for (const auto &m : merged) {
+            if (!m.count) {
+                continue;
+            }
+            result.emplace_back(LatencyStats {detail::demangle(detail::stateNames().name(m.state)),
+                                              detail::demangle(detail::eventNames().name(m.event)),
+                                              m.count,
+                                              toNs(m.sum / m.count),
+                                              toNs(percentile(m, 0.5)),
+                                              toNs(percentile(m, 0.99)),
+                                              toNs(m.max)});
+        }
+        std::sort(result.begin(), result.end(), [](const auto &a, const auto &b) { return a.max > b.max; });
+        return result;
+    }
+
+    /// @brief Prints latencies of reactions as table.
+    void report(std::ostream &os)
+    {
+        os << std::left << std::setw(32) << "state" << std::setw(32) << "event" << std::right << std::setw(10)
+           << "count" << std::setw(12) << "mean ns" << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns"
+           << std::setw(12) << "max ns" << std::endl;
+        for (const auto &l : latencies()) {
+            os << std::left << std::setw(32) << l.state << std::setw(32) << l.event << std::right << std::setw(10)
+               << l.count << std::setw(12) << l.mean.count() << std::setw(12) << l.p50.count() << std::setw(12)
+               << l.p99.count() << std::setw(12) << l.max.count() << std::endl;
+        }
+    }
+
+    /// @brief Returns data of calling thread, registered until thread exits.
+    static detail::ThreadData &threadData()
+    {
+        // constant-initialized pointer: no initialization guard on reaction path
+        thread_local detail::ThreadData *data = nullptr;
+        if (!data) {
+            data = &instance().attach();
+        }
+        return *data;
+    }
+
+    /// @brief Returns number of threads which reacted and did not exit yet.
+    size_t threadCount()
+    {
+        std::lock_guard<std::mutex> lock(m_threadsMutex);
+        return m_threads.size();
+    }
+
+private:
+    /// @brief Unregisters data of thread on its exit.
+    struct ThreadHandle {
+        ~ThreadHandle()
+        {
+            if (data) {
+                Watchdog::instance().retire(data);
+            }
+        }
+
+        std::shared_ptr<detail::ThreadData> data;
+    };
+
+    Watchdog() = default;
+
+    /// @brief Registers data of calling thread, called once per thread.
+    detail::ThreadData &attach()
+    {
+        thread_local ThreadHandle handle;
+        handle.data = std::make_shared<detail::ThreadData>();
+        std::lock_guard<std::mutex> lock(m_threadsMutex);
+        m_threads.emplace_back(handle.data);
+        return *handle.data;
+    }
+
+    /// @brief Merges histograms of exited thread into retired ones and stops scanning thread.
+    void retire(const std::shared_ptr<detail::ThreadData> &data)
+    {
+        std::lock_guard<std::mutex> lock(m_threadsMutex);
+        m_threads.erase(std::remove(m_threads.begin(), m_threads.end(), data), m_threads.end());
+        data->forEach([&](TypeId st, TypeId ev, const Histogram &h) {
+            detail::aggregateOf(m_retired, st, ev).add(h);
+        });
+    }
+
+    std::vector<std::shared_ptr<detail::ThreadData>> threads()
+    {
+        std::lock_guard<std::mutex> lock(m_threadsMutex);
+        return m_threads;
+    }
+
+    /// @brief Reports slow reactions, called by monitor thread.
+    void check(uint64_t budgetTicks)
+    {
+        const uint64_t now = ticks();
+        for (const auto &data : threads()) {
+            const uint64_t start = data->start.load(std::memory_order_acquire);
+            if (!start || now < start || now - start <= budgetTicks || data->reported == start) {
+                continue;
+            }
+
+            const void *context = data->context.load(std::memory_order_relaxed);
+            const auto st = data->state.load(std::memory_order_relaxed);
+            const auto ev = data->event.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (data->start.load(std::memory_order_relaxed) != start) {
+                // slot is updated meanwhile
+                continue;
+            }
+
+            data->reported = start;
+            m_slow.fetch_add(1, std::memory_order_relaxed);
+            m_callback(SlowReaction {context,
+                                     detail::demangle(detail::stateNames().name(st)),
+                                     detail::demangle(detail::eventNames().name(ev)),
+                                     std::chrono::nanoseconds(static_cast<int64_t>(
+                                         static_cast<double>(now - start) / ticksPerNs()))});
+        }
+    }
+
+    std::mutex m_threadsMutex;
+    std::vector<std::shared_ptr<detail::ThreadData>> m_threads;
+
+    /// @brief latencies of exited threads
+    std::vector<detail::Aggregate> m_retired;
+
+    std::mutex m_monitorMutex;
+    std::condition_variable m_monitorCv;
+    std::thread m_monitor;
+    bool m_stopping = false;
+    Callback m_callback;
+    std::atomic<uint64_t> m_slow {0};
+};
+
+/**
+ * @brief Reaction marks reaction of state on event in slot of calling thread while it exists.
+ * Nested reactions (context reacting calls another context) restore outer reaction on exit.
+ */
+class Reaction
+{
+public:
+    Reaction(const void *context, TypeId state, TypeId event)
+        : m_data(Watchdog::threadData())
+        , m_outerStart(m_data.start.load(std::memory_order_relaxed))
+        , m_outerContext(m_data.context.load(std::memory_order_relaxed))
+        , m_outerState(m_data.state.load(std::memory_order_relaxed))
+        , m_outerEvent(m_data.event.load(std::memory_order_relaxed))
+        , m_state(state)
+        , m_event(event)
+    {
+        m_start = ticks();
+        m_data.publish(m_start, context, state, event);
+    }
+
+    ~Reaction()
+    {
+        const uint64_t duration = ticks() - m_start;
+        if (m_outerStart) {
+            m_data.publish(m_outerStart, m_outerContext, m_outerState, m_outerEvent);
+        } else {
+            m_data.start.store(0, std::memory_order_release);
+        }
+
+        if (auto *h = m_data.histogram(m_state, m_event)) {
+            h->add(duration);
+        }
+    }
+
+private:
+    detail::ThreadData &m_data;
+    const uint64_t m_outerStart;
+    const void *const m_outerContext;
+    const TypeId m_outerState;
+    const TypeId m_outerEvent;
+    const TypeId m_state;
+    const TypeId m_event;
+    uint64_t m_start = 0;
+
+    Reaction(const Reaction &) = delete;
+    Reaction &operator=(const Reaction &) = delete;
+};
+
+} // namespace psi::sm::watchdog
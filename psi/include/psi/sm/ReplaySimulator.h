@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace psi::sm {
+
+/**
+ * @brief ReplaySimulator drives recorded event streams of many machines through contexts in parallel,
+ * e.g. to backtest states against recorded traffic.
+ * The concept is:
+ * - each record carries key of machine, one context is created per key by factory on its first record
+ * - keys are partitioned between shards by hash, each shard is processed by its own thread
+ * - records of one key are processed in order of recording, records of different keys are not ordered
+ * - records are read in place (e.g. from @EventLogReader) and never copied
+ * - records of shard are grouped by buckets of keys before replay, so contexts being fed stay in cache
+ * - factory receives memory resource of shard for states and queued events of context
+ * - contexts are locked by shard's thread once per run, so processing of events does not perform atomic operations
+ *
+ * @tparam Context type of context, derived from @BaseContext<IState>
+ */
+template <typename Context>
+class ReplaySimulator
+{
+public:
+    /// @brief Creates context of machine: 'std::unique_ptr<Context>(uint64_t key, std::pmr::memory_resource *)'.
+    using Factory = std::function<std::unique_ptr<Context>(uint64_t, std::pmr::memory_resource *)>;
+
+    struct Stats {
+        /// @brief number of processed records
+        size_t events = 0;
+
+        /// @brief number of created contexts
+        size_t contexts = 0;
+
+        /// @brief number of records processed by each shard, shows balance of partitioning
+        std::vector<size_t> shardEvents;
+
+        std::chrono::nanoseconds partitionTime {0};
+        std::chrono::nanoseconds replayTime {0};
+    };
+
+    /**
+     * @brief Construct a new ReplaySimulator object.
+     *
+     * @param factory factory of contexts
+     * @param threads number of shards, number of hardware threads by default
+     */
+    explicit ReplaySimulator(Factory factory, unsigned threads = std::thread::hardware_concurrency())
+        : m_factory(std::move(factory))
+        , m_shards(std::max(1u, threads))
+    {
+    }
+
+    /**
+     * @brief Replays records. May be called several times, contexts keep their states between calls.
+     *
+     * @tparam Record type of record
+     * @tparam KeyFn type of function 'uint64_t(const Record &)'
+     * @tparam FeedFn type of function 'void(Context &, const Record &)' passing record to context
+     * @param records pointer to first record
+     * @param count number of records
+     * @param key function returning key of machine
+     * @param feed function passing record to context
+     * @return Stats statistics of replay
+     */
+    template <typename Record, typename KeyFn, typename FeedFn>
+    Stats run(const Record *records, size_t count, KeyFn key, FeedFn feed)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        const size_t shards = m_shards.size();
+        // chunks are small enough for 32-bit offsets and numerous enough to balance partitioning
+        const size_t chunkSize =
+            std::min<size_t>(std::max<size_t>((count + shards * 4 - 1) / (shards * 4), 1), UINT32_MAX);
+        const size_t chunks = (count + chunkSize - 1) / chunkSize;
+
+        // records of each shard within chunk: partition[chunk * shards + shard]
+        std::vector<std::vector<Item>> partition(chunks * shards);
+
+        const auto start = Clock::now();
+        parallel(std::min(shards, chunks), [&](size_t worker, size_t workers) {
+            for (size_t c = worker; c < chunks; c += workers) {
+                const size_t begin = c * chunkSize;
+                const size_t end = std::min(begin + chunkSize, count);
+                auto *out = &partition[c * shards];
+                for (size_t s = 0; s < shards; ++s) {
+                    out[s].reserve((end - begin) / shards + 16);
+                }
+                for (size_t i = begin; i < end; ++i) {
+                    const uint64_t hash = hashOf(key(records[i]));
+                    out[hash % shards].push_back(Item {static_cast<uint32_t>(i - begin), bucketOf(hash)});
+                }
+            }
+        });
+
+        const auto partitioned = Clock::now();
+        parallel(shards, [&](size_t s, size_t) {
+            Shard &shard = m_shards[s];
+            ++shard.run;
+
+            // stable counting sort by bucket: records of one key stay in order, contexts of bucket stay in cache
+            std::vector<size_t> offsets(Buckets + 1);
+            for (size_t c = 0; c < chunks; ++c) {
+                for (const auto &item : partition[c * shards + s]) {
+                    ++offsets[item.bucket + 1];
+                }
+            }
+            for (size_t b = 0; b < Buckets; ++b) {
+                offsets[b + 1] += offsets[b];
+            }
+            std::vector<const Record *> grouped(offsets[Buckets]);
+            for (size_t c = 0; c < chunks; ++c) {
+                auto &items = partition[c * shards + s];
+                const Record *chunk = records + c * chunkSize;
+                for (const auto &item : items) {
+                    grouped[offsets[item.bucket]++] = chunk + item.offset;
+                }
+                std::vector<Item>().swap(items);
+            }
+
+            uint64_t lastKey = 0;
+            Context *last = nullptr;
+            for (size_t i = 0; i < grouped.size(); ++i) {
+                if (i + Prefetch < grouped.size()) {
+                    prefetch(grouped[i + Prefetch]);
+                }
+                const Record &record = *grouped[i];
+                const uint64_t k = key(record);
+                if (!last || k != lastKey) {
+                    last = &shard.context(k, m_factory);
+                    lastKey = k;
+                }
+                feed(*last, record);
+            }
+            shard.events += grouped.size();
+            shard.unlock();
+        });
+
+        Stats stats;
+        stats.partitionTime = partitioned - start;
+        stats.replayTime = Clock::now() - partitioned;
+        for (auto &shard : m_shards) {
+            stats.events += shard.events;
+            stats.contexts += shard.contexts.size();
+            stats.shardEvents.emplace_back(shard.events);
+            shard.events = 0;
+        }
+        return stats;
+    }
+
+    /**
+     * @brief Calls function for each context. Must not be called concurrently with 'run'.
+     *
+     * @tparam Fn type of function 'void(uint64_t key, Context &)'
+     * @param fn function object
+     */
+    template <typename Fn>
+    void forEach(Fn &&fn)
+    {
+        for (auto &shard : m_shards) {
+            for (auto &[k, entry] : shard.contexts) {
+                fn(k, *entry.context);
+            }
+        }
+    }
+
+    /// @brief Returns number of shards.
+    size_t shards() const
+    {
+        return m_shards.size();
+    }
+
+private:
+    struct Shard {
+        /// @brief Returns context of key, context is locked by calling thread until end of run.
+        Context &context(uint64_t key, const Factory &factory)
+        {
+            auto &entry = contexts[key];
+            if (!entry.context) {
+                entry.context = factory(key, &resource);
+            }
+            if (entry.run != run) {
+                entry.context->mutex().lock();
+                entry.run = run;
+                locked.emplace_back(entry.context.get());
+            }
+            return *entry.context;
+        }
+
+        void unlock()
+        {
+            for (auto *context : locked) {
+                context->mutex().unlock();
+            }
+            locked.clear();
+        }
+
+        struct Entry {
+            std::unique_ptr<Context> context;
+
+            /// @brief last run which locked context
+            uint64_t run = 0;
+        };
+
+        /// @brief declared before contexts, which are allocated from it
+        std::pmr::unsynchronized_pool_resource resource;
+        std::unordered_map<uint64_t, Entry> contexts;
+        std::vector<Context *> locked;
+        uint64_t run = 0;
+        size_t events = 0;
+    };
+
+    /// @brief number of buckets records of shard are grouped by before replay
+    static constexpr size_t Buckets = 1 << 16;
+
+    /// @brief distance in records of prefetching during replay
+    static constexpr size_t Prefetch = 8;
+
+    struct Item {
+        /// @brief offset of record within chunk
+        uint32_t offset;
+        uint32_t bucket;
+    };
+
+    static uint64_t hashOf(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    static uint32_t bucketOf(uint64_t hash)
+    {
+        // high bits, low bits select shard
+        return static_cast<uint32_t>(hash >> 48);
+    }
+
+    static void prefetch(const void *p)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(p);
+#else
+        (void)p;
+#endif
+    }
+
+    /// @brief Runs function in several threads and waits for them: 'void(size_t worker, size_t workers)'.
+    template <typename Fn>
+    static void parallel(size_t workers, Fn &&fn)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(workers);
+        for (size_t w = 1; w < workers; ++w) {
+            threads.emplace_back([&fn, w, workers]() { fn(w, workers); });
+        }
+        if (workers) {
+            fn(0, workers);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    Factory m_factory;
+    std::vector<Shard> m_shards;
+
+    ReplaySimulator(const ReplaySimulator &) = delete;
+    ReplaySimulator &operator=(const ReplaySimulator &) = delete;
+};
+
+} // namespace psi::sm
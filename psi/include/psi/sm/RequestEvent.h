@@ -0,0 +1,465 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "ExpiringEvent.h"
+#include "ProcessResult.h"
+#include "StateId.h"
+
+namespace psi::sm {
+
+/// @brief Final outcome of requested event.
+struct RequestResult {
+    /// @brief result of last reaction on event, DiscardedEvent if event was dropped without reaction
+    ProcessResult result = ProcessResult::DiscardedEvent;
+
+    /// @brief identifier of context's state right after last reaction, InvalidStateId if event was dropped
+    StateId state = InvalidStateId;
+};
+
+namespace detail {
+
+/**
+ * @brief Completion is a pooled slot shared by requested event and its future.
+ */
+struct Completion {
+    static constexpr uint32_t Pending = 0;
+    static constexpr uint32_t Done = 1;
+    static constexpr uint32_t Waiting = 2;
+
+    /// @brief futex word: Pending, Done or Waiting (pending and waiter sleeps)
+    std::atomic<uint32_t> status {Pending};
+
+    /// @brief number of owners: copies of event handle plus future
+    std::atomic<uint32_t> refs {0};
+
+    /// @brief number of event handle copies, event is dropped when last one is released without completion
+    std::atomic<uint32_t> handles {0};
+
+    /// @brief next free slot in pool, index + 1
+    std::atomic<uint32_t> nextFree {0};
+
+    /// @brief index of slot in pool, HeapIndex if completion is allocated outside of pool
+    uint32_t index = 0;
+
+    static constexpr uint32_t HeapIndex = UINT32_MAX;
+
+    /// @brief set by first completer, further completions are ignored
+    std::atomic<bool> claimed {false};
+
+    RequestResult value;
+
+    void complete(ProcessResult rs, StateId state)
+    {
+        if (claimed.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        value = RequestResult {rs, state};
+        if (status.exchange(Done, std::memory_order_acq_rel) == Waiting) {
+#ifdef __linux__
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&status), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+        }
+    }
+};
+
+/**
+ * @brief CompletionPool is a process-wide lock-free pool of completions.
+ * Pool grows by chunks while number of requests in flight grows, then slots are reused without allocations.
+ * Once MaxChunks are in use, further completions are allocated on heap one by one.
+ */
+class CompletionPool
+{
+public:
+    static constexpr uint32_t ChunkSize = 1024;
+    static constexpr uint32_t MaxChunks = 1024;
+
+    static CompletionPool &instance()
+    {
+        static CompletionPool pool;
+        return pool;
+    }
+
+    ~CompletionPool()
+    {
+        for (auto &chunk : m_chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief Takes free slot from pool, allocates completion on heap if pool is exhausted.
+    Completion *acquire()
+    {
+        for (;;) {
+            uint64_t head = m_free.load(std::memory_order_acquire);
+            const auto index = static_cast<uint32_t>(head);
+            if (!index) {
+                if (!grow()) {
+                    auto *completion = new Completion;
+                    completion->index = Completion::HeapIndex;
+                    return completion;
+                }
+                continue;
+            }
+
+            Completion *slot = at(index - 1);
+            const uint64_t next = ((head >> 32) + 1) << 32 | slot->nextFree.load(std::memory_order_relaxed);
+            if (m_free.compare_exchange_weak(head, next, std::memory_order_acq_rel)) {
+                slot->status.store(Completion::Pending, std::memory_order_relaxed);
+                slot->claimed.store(false, std::memory_order_relaxed);
+                slot->value = RequestResult {};
+                return slot;
+            }
+        }
+    }
+
+    /// @brief Returns slot to pool.
+    void release(Completion *slot)
+    {
+        if (slot->index == Completion::HeapIndex) {
+            delete slot;
+            return;
+        }
+        push(slot->index + 1, slot);
+    }
+
+    /// @brief Returns number of slots allocated by pool.
+    size_t capacity() const
+    {
+        return static_cast<size_t>(m_chunkCount.load(std::memory_order_acquire)) * ChunkSize;
+    }
+
+private:
+    CompletionPool() = default;
+
+    Completion *at(uint32_t index) const
+    {
+        return &m_chunks[index / ChunkSize].load(std::memory_order_acquire)[index % ChunkSize];
+    }
+
+    void push(uint32_t index, Completion *slot)
+    {
+        uint64_t head = m_free.load(std::memory_order_relaxed);
+        do {
+            slot->nextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        } while (!m_free.compare_exchange_weak(
+            head, ((head >> 32) + 1) << 32 | index, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool grow()
+    {
+        std::lock_guard<std::mutex> lock(m_growMutex);
+        if (static_cast<uint32_t>(m_free.load(std::memory_order_acquire))) {
+            return true;
+        }
+
+        const auto count = m_chunkCount.load(std::memory_order_relaxed);
+        if (count == MaxChunks) {
+            return false;
+        }
+
+        auto *chunk = new Completion[ChunkSize];
+        m_chunks[count].store(chunk, std::memory_order_release);
+        m_chunkCount.store(count + 1, std::memory_order_release);
+        for (uint32_t i = ChunkSize; i > 0; --i) {
+            chunk[i - 1].index = count * ChunkSize + i - 1;
+            push(count * ChunkSize + i, &chunk[i - 1]);
+        }
+        return true;
+    }
+
+    /// @brief head of free list: ABA tag in high half, index + 1 of slot in low half
+    std::atomic<uint64_t> m_free {0};
+
+    std::array<std::atomic<Completion *>, MaxChunks> m_chunks {};
+    std::atomic<uint32_t> m_chunkCount {0};
+    std::mutex m_growMutex;
+};
+
+inline void releaseRef(Completion *c)
+{
+    if (c->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        CompletionPool::instance().release(c);
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief RequestFuture completes once requested event leaves context's queues, see 'BaseContext::request_event'.
+ * Move-only, waiting does not allocate.
+ */
+class RequestFuture
+{
+public:
+    RequestFuture() = default;
+
+    explicit RequestFuture(detail::Completion *completion)
+        : m_completion(completion)
+    {
+        if (m_completion) {
+            m_completion->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    RequestFuture(RequestFuture &&other) noexcept
+        : m_completion(other.m_completion)
+    {
+        other.m_completion = nullptr;
+    }
+
+    RequestFuture &operator=(RequestFuture &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            m_completion = other.m_completion;
+            other.m_completion = nullptr;
+        }
+        return *this;
+    }
+
+    ~RequestFuture()
+    {
+        reset();
+    }
+
+    /// @brief Returns true if future is bound to request. Futures returned by 'request_event' are always valid.
+    bool valid() const
+    {
+        return m_completion != nullptr;
+    }
+
+    /// @brief Returns true if event left context's queues.
+    bool ready() const
+    {
+        return !m_completion || m_completion->status.load(std::memory_order_acquire) == detail::Completion::Done;
+    }
+
+    /// @brief Waits until event leaves context's queues and returns its outcome.
+    RequestResult wait() const
+    {
+        wait_impl(nullptr);
+        return result();
+    }
+
+    /**
+     * @brief Waits until event leaves context's queues or timeout expires.
+     *
+     * @param timeout max waiting time
+     * @return std::optional<RequestResult> outcome of event, std::nullopt on timeout
+     */
+    std::optional<RequestResult> wait_for(std::chrono::nanoseconds timeout) const
+    {
+        if (!wait_impl(&timeout)) {
+            return std::nullopt;
+        }
+        return result();
+    }
+
+private:
+    RequestResult result() const
+    {
+        return m_completion ? m_completion->value : RequestResult {};
+    }
+
+    bool wait_impl(const std::chrono::nanoseconds *timeout) const
+    {
+        if (!m_completion) {
+            return true;
+        }
+
+        auto &status = m_completion->status;
+        const auto deadline = std::chrono::steady_clock::now() + (timeout ? *timeout : std::chrono::nanoseconds(0));
+        for (int spin = 0; spin < 128; ++spin) {
+            if (status.load(std::memory_order_acquire) == detail::Completion::Done) {
+                return true;
+            }
+        }
+
+        for (;;) {
+            uint32_t expected = detail::Completion::Pending;
+            status.compare_exchange_strong(expected, detail::Completion::Waiting, std::memory_order_acq_rel);
+            if (expected == detail::Completion::Done) {
+                return true;
+            }
+
+            std::chrono::nanoseconds left {0};
+            if (timeout) {
+                left = deadline - std::chrono::steady_clock::now();
+                if (left.count() <= 0) {
+                    return status.load(std::memory_order_acquire) == detail::Completion::Done;
+                }
+            }
+#ifdef __linux__
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(left.count() / 1000000000);
+            ts.tv_nsec = static_cast<long>(left.count() % 1000000000);
+            ::syscall(SYS_futex,
+                      reinterpret_cast<uint32_t *>(&status),
+                      FUTEX_WAIT_PRIVATE,
+                      detail::Completion::Waiting,
+                      timeout ? &ts : nullptr,
+                      nullptr,
+                      0);
+#else
+            std::this_thread::yield();
+#endif
+        }
+    }
+
+    void reset()
+    {
+        if (m_completion) {
+            detail::releaseRef(m_completion);
+            m_completion = nullptr;
+        }
+    }
+
+    detail::Completion *m_completion = nullptr;
+
+    RequestFuture(const RequestFuture &) = delete;
+    RequestFuture &operator=(const RequestFuture &) = delete;
+};
+
+/**
+ * @brief RequestEvent is an event whose final outcome is reported to @RequestFuture.
+ * States react on underlying event object as usual. Copies share completion, request is completed by
+ * first final reaction (any result except DeferredEvent and PostedEvent) or, if all copies are destroyed
+ * without it, with DiscardedEvent.
+ *
+ * @tparam T type of event
+ */
+template <typename T>
+class RequestEvent
+{
+public:
+    /**
+     * @brief Construct a new RequestEvent object with completion from pool (from heap if pool is exhausted).
+     *
+     * @param ev event object
+     */
+    explicit RequestEvent(T ev)
+        : event(std::move(ev))
+        , m_completion(detail::CompletionPool::instance().acquire())
+    {
+        m_completion->refs.store(1, std::memory_order_relaxed);
+        m_completion->handles.store(1, std::memory_order_relaxed);
+    }
+
+    RequestEvent(const RequestEvent &other)
+        : event(other.event)
+        , m_completion(other.m_completion)
+    {
+        if (m_completion) {
+            m_completion->refs.fetch_add(1, std::memory_order_relaxed);
+            m_completion->handles.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    RequestEvent(RequestEvent &&other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        : event(std::move(other.event))
+        , m_completion(other.m_completion)
+    {
+        other.m_completion = nullptr;
+    }
+
+    RequestEvent &operator=(const RequestEvent &) = delete;
+
+    ~RequestEvent()
+    {
+        if (!m_completion) {
+            return;
+        }
+        if (m_completion->handles.fetch_sub(1, std::memory_order_acq_rel) == 1
+            && m_completion->status.load(std::memory_order_acquire) != detail::Completion::Done) {
+            m_completion->complete(ProcessResult::DiscardedEvent, InvalidStateId);
+        }
+        detail::releaseRef(m_completion);
+    }
+
+    /// @brief Returns future of request.
+    RequestFuture future() const
+    {
+        return RequestFuture(m_completion);
+    }
+
+    /// @brief Completes request if result of reaction is final.
+    void complete(ProcessResult rs, StateId state) const
+    {
+        if (m_completion && rs != ProcessResult::DeferredEvent && rs != ProcessResult::PostedEvent
+            && m_completion->status.load(std::memory_order_relaxed) != detail::Completion::Done) {
+            m_completion->complete(rs, state);
+        }
+    }
+
+    /// @brief event object
+    T event;
+
+private:
+    detail::Completion *m_completion;
+};
+
+/**
+ * @brief Returns object to be reacted by state.
+ *
+ * @tparam T type of event
+ * @param ev requested event object
+ * @return underlying event object
+ */
+template <typename T>
+decltype(auto) event_ref(const RequestEvent<T> &ev)
+{
+    return event_ref(ev.event);
+}
+
+/// @brief Requested event expires together with underlying event.
+template <typename T>
+bool is_expired(const RequestEvent<T> &ev)
+{
+    return is_expired(ev.event);
+}
+
+template <typename T>
+struct IsExpiring<RequestEvent<T>> : IsExpiring<T> {
+};
+
+/**
+ * @brief Reports result of reaction to requester. Plain events have no requester.
+ */
+template <typename T>
+void complete_request(const T &, ProcessResult, StateId)
+{
+}
+
+/**
+ * @brief Reports result of reaction to requester.
+ *
+ * @tparam T type of event
+ * @param ev requested event object
+ * @param rs result of reaction
+ * @param state identifier of context's state after reaction
+ */
+template <typename T>
+void complete_request(const RequestEvent<T> &ev, ProcessResult rs, StateId state)
+{
+    ev.complete(rs, state);
+}
+
+} // namespace psi::sm
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace psi::sm {
+
+template <typename Signature>
+class ResourceFunction;
+
+/**
+ * @brief ResourceFunction is a move-only replacement of std::function whose target is allocated from
+ * std::pmr::memory_resource. Targets of up to two pointers are stored inline and never allocate.
+ * Has the same size as std::function of libstdc++ (32 bytes on 64-bit platforms).
+ *
+ * @tparam R type of result
+ * @tparam Args types of arguments
+ */
+template <typename R, typename... Args>
+class ResourceFunction<R(Args...)>
+{
+    using Storage = std::aligned_storage_t<2 * sizeof(void *), alignof(void *)>;
+
+    template <typename Fn>
+    static constexpr bool IsInline = sizeof(Fn) <= sizeof(Storage) && alignof(Fn) <= alignof(Storage)
+                                     && std::is_nothrow_move_constructible_v<Fn>;
+
+public:
+    ResourceFunction() = default;
+
+    /**
+     * @brief Construct a new ResourceFunction object.
+     *
+     * @tparam F type of callable
+     * @param fn callable object
+     * @param resource memory resource used if target does not fit inline storage
+     */
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, ResourceFunction>>>
+    ResourceFunction(F &&fn, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+    {
+        using Fn = std::decay_t<F>;
+
+        if constexpr (IsInline<Fn>) {
+            ::new (&m_storage) Fn(std::forward<F>(fn));
+        } else {
+            void *mem = resource->allocate(sizeof(Fn), alignof(Fn));
+            try {
+                ::new (mem) Fn(std::forward<F>(fn));
+            } catch (...) {
+                resource->deallocate(mem, sizeof(Fn), alignof(Fn));
+                throw;
+            }
+            *reinterpret_cast<void **>(&m_storage) = mem;
+            m_resource = resource;
+        }
+        m_ops = &OpsOf<Fn>::ops;
+    }
+
+    ResourceFunction(ResourceFunction &&other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    ResourceFunction &operator=(ResourceFunction &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~ResourceFunction()
+    {
+        reset();
+    }
+
+    /// @brief Calls target. Target must exist.
+    R operator()(Args... args) const
+    {
+        return m_ops->invoke(const_cast<Storage &>(m_storage), std::forward<Args>(args)...);
+    }
+
+    /// @brief Returns true if target exists.
+    explicit operator bool() const
+    {
+        return m_ops != nullptr;
+    }
+
+    /**
+     * @brief Returns target if it has specified type.
+     *
+     * @tparam F type of target
+     * @return const F* pointer to target, nullptr if target has another type or does not exist
+     */
+    template <typename F>
+    const F *target() const
+    {
+        return m_ops && m_ops->type == &TypeTag<F> ? &targetOf<F>(const_cast<Storage &>(m_storage)) : nullptr;
+    }
+
+    /// @brief Returns memory resource of target, nullptr if target is stored inline or does not exist.
+    std::pmr::memory_resource *resource() const
+    {
+        return m_resource;
+    }
+
+private:
+    struct Ops {
+        R (*invoke)(Storage &, Args &&...);
+        void (*relocate)(Storage &dst, Storage &src);
+        void (*destroy)(Storage &, std::pmr::memory_resource *);
+        const void *type;
+    };
+
+    /// @brief unique address per target type, checking type does not instantiate operations
+    template <typename Fn>
+    static constexpr char TypeTag = 0;
+
+    template <typename Fn>
+    static Fn &targetOf(Storage &s)
+    {
+        if constexpr (IsInline<Fn>) {
+            return *std::launder(reinterpret_cast<Fn *>(&s));
+        } else {
+            return **reinterpret_cast<Fn **>(&s);
+        }
+    }
+
+    template <typename Fn>
+    struct OpsOf {
+        static Fn &target(Storage &s)
+        {
+            return targetOf<Fn>(s);
+        }
+
+        static R invoke(Storage &s, Args &&...args)
+        {
+            return target(s)(std::forward<Args>(args)...);
+        }
+
+        static void relocate(Storage &dst, Storage &src)
+        {
+            if constexpr (IsInline<Fn>) {
+                ::new (&dst) Fn(std::move(target(src)));
+                target(src).~Fn();
+            } else {
+                dst = src;
+            }
+        }
+
+        static void destroy(Storage &s, std::pmr::memory_resource *resource)
+        {
+            if constexpr (IsInline<Fn>) {
+                (void)resource;
+                target(s).~Fn();
+            } else {
+                Fn *fn = &target(s);
+                fn->~Fn();
+                resource->deallocate(fn, sizeof(Fn), alignof(Fn));
+            }
+        }
+
+        static constexpr Ops ops = {&invoke, &relocate, &destroy, &TypeTag<Fn>};
+    };
+
+    void moveFrom(ResourceFunction &other) noexcept
+    {
+        if (other.m_ops) {
+            other.m_ops->relocate(m_storage, other.m_storage);
+            m_ops = other.m_ops;
+            m_resource = other.m_resource;
+            other.m_ops = nullptr;
+            other.m_resource = nullptr;
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (m_ops) {
+            m_ops->destroy(m_storage, m_resource);
+            m_ops = nullptr;
+            m_resource = nullptr;
+        }
+    }
+
+    Storage m_storage;
+    const Ops *m_ops = nullptr;
+    std::pmr::memory_resource *m_resource = nullptr;
+};
+
+} // namespace psi::sm
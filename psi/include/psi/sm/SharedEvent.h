@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+namespace psi::sm {
+
+/**
+ * @brief SharedEvent is an immutable ref-counted event.
+ * Context accepts it as any other event and reacts on underlying object, while queues copy only the pointer.
+ * Useful for big events or events delivered to many contexts.
+ *
+ * @tparam T type of event
+ */
+template <typename T>
+using SharedEvent = std::shared_ptr<const T>;
+
+/**
+ * @brief Creates shared event.
+ *
+ * @tparam T type of event
+ * @tparam Args types of event's constructor arguments
+ * @param args event's constructor arguments
+ * @return SharedEvent<T> shared event object
+ */
+template <typename T, typename... Args>
+SharedEvent<T> make_shared_event(Args &&...args)
+{
+    return std::make_shared<const T>(std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Returns object to be reacted by state.
+ *
+ * @tparam T type of event
+ * @param ev event object
+ * @return const T& event object itself
+ */
+template <typename T>
+const T &event_ref(const T &ev)
+{
+    return ev;
+}
+
+/**
+ * @brief Returns object to be reacted by state.
+ *
+ * @tparam T type of event
+ * @param ev shared event object
+ * @return const T& underlying event object
+ */
+template <typename T>
+const T &event_ref(const SharedEvent<T> &ev)
+{
+    return *ev;
+}
+
+} // namespace psi::sm
@@ -0,0 +1,320 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace psi::sm {
+
+/**
+ * @brief ShmEventRing is a bounded MPSC ring buffer of events living in shared memory (/dev/shm).
+ * It is used to feed events produced by other processes of the same host directly into context.
+ * The concept is:
+ * - events must be trivially copyable, they are copied into ring slots as is
+ * - any number of producers (threads or processes) push events, single consumer drains them into context
+ * - push and pop do not perform syscalls, consumer parks on futex only when ring is empty
+ *
+ * Ring is created by consumer and opened by producers with the same name, type of event and capacity.
+ * Creation fails while name exists, name is removed by 'unlink'.
+ *
+ * @tparam T type of event
+ * @tparam Capacity number of slots, power of 2
+ */
+template <typename T, size_t Capacity>
+class ShmEventRing
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Event must be trivially copyable");
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be power of 2");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared atomics must be lock free");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared atomics must be lock free");
+
+public:
+    ~ShmEventRing()
+    {
+        ::munmap(m_header, MappingSize);
+    }
+
+    /**
+     * @brief Creates ring in shared memory.
+     * Existing ring is never reset, since it may have attached producers and consumer: to re-create ring,
+     * e.g. after crash of consumer, its name must be removed by 'unlink' first.
+     *
+     * @param name name of shared memory object, e.g. "/my-ring"
+     * @return std::unique_ptr<ShmEventRing> ring object, nullptr if ring with this name exists
+     * or shared memory is not available
+     */
+    static std::unique_ptr<ShmEventRing> create(const std::string &name)
+    {
+        const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        if (::ftruncate(fd, MappingSize) != 0) {
+            ::close(fd);
+            unlink(name);
+            return nullptr;
+        }
+
+        auto ring = map(fd);
+        if (!ring) {
+            unlink(name);
+            return nullptr;
+        }
+
+        auto header = new (ring->m_header) Header();
+        for (size_t i = 0; i < Capacity; ++i) {
+            new (&ring->m_slots[i]) Slot();
+            ring->m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        header->capacity = Capacity;
+        header->eventSize = sizeof(T);
+        header->magic.store(Magic, std::memory_order_release);
+
+        return ring;
+    }
+
+    /**
+     * @brief Opens ring created by another process.
+     *
+     * @param name name of shared memory object
+     * @return std::unique_ptr<ShmEventRing> ring object, nullptr if ring does not exist or has another layout
+     */
+    static std::unique_ptr<ShmEventRing> open(const std::string &name)
+    {
+        const int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != MappingSize) {
+            ::close(fd);
+            return nullptr;
+        }
+
+        auto ring = map(fd);
+        if (!ring) {
+            return nullptr;
+        }
+
+        const auto header = ring->m_header;
+        if (header->magic.load(std::memory_order_acquire) != Magic || header->capacity != Capacity
+            || header->eventSize != sizeof(T)) {
+            return nullptr;
+        }
+
+        return ring;
+    }
+
+    /**
+     * @brief Removes name of shared memory object. Already mapped rings remain valid.
+     *
+     * @param name name of shared memory object
+     */
+    static void unlink(const std::string &name)
+    {
+        ::shm_unlink(name.c_str());
+    }
+
+    /**
+     * @brief Pushes event to ring.
+     * Operation is thread-safe and process-safe.
+     *
+     * @param ev event object
+     * @return true if event is pushed
+     * @return false if ring is full
+     */
+    bool try_push(const T &ev)
+    {
+        auto &head = m_header->head;
+        uint64_t pos = head.load(std::memory_order_relaxed);
+
+        Slot *slot;
+        for (;;) {
+            slot = &m_slots[pos & Mask];
+            const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<int64_t>(seq - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->event = ev;
+        slot->seq.store(pos + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_header->sleeping.load(std::memory_order_relaxed)) {
+            m_header->wakeups.fetch_add(1, std::memory_order_release);
+            futex(&m_header->wakeups, FUTEX_WAKE, INT_MAX, nullptr);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Pops oldest event from ring.
+     * Must be called by single consumer.
+     *
+     * @return std::optional<T> event object if ring is not empty
+     */
+    std::optional<T> try_pop()
+    {
+        auto &tail = m_header->tail;
+        const uint64_t pos = tail.load(std::memory_order_relaxed);
+
+        Slot &slot = m_slots[pos & Mask];
+        if (slot.seq.load(std::memory_order_acquire) != pos + 1) {
+            return std::nullopt;
+        }
+
+        T ev = slot.event;
+        slot.seq.store(pos + Capacity, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+
+        return ev;
+    }
+
+    /**
+     * @brief Passes events from ring to context.
+     * Must be called by single consumer.
+     *
+     * @tparam Context type of context
+     * @param context receiver of events
+     * @param limit max number of events to be processed
+     * @return size_t number of processed events
+     */
+    template <typename Context>
+    size_t drain(Context &context, size_t limit = Capacity)
+    {
+        size_t processed = 0;
+        while (processed < limit) {
+            auto ev = try_pop();
+            if (!ev) {
+                break;
+            }
+            context.process_event(*ev);
+            ++processed;
+        }
+        return processed;
+    }
+
+    /**
+     * @brief Parks consumer until ring is not empty or timeout is expired.
+     * Must be called by single consumer.
+     *
+     * @param timeout max waiting time
+     * @return true if ring is not empty
+     * @return false if timeout is expired
+     */
+    bool wait(std::chrono::nanoseconds timeout)
+    {
+        if (!empty()) {
+            return true;
+        }
+
+        const uint32_t wakeups = m_header->wakeups.load(std::memory_order_acquire);
+        m_header->sleeping.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (empty()) {
+            const auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(secs.count());
+            ts.tv_nsec = static_cast<long>((timeout - secs).count());
+            futex(&m_header->wakeups, FUTEX_WAIT, wakeups, &ts);
+        }
+
+        m_header->sleeping.fetch_sub(1, std::memory_order_relaxed);
+        return !empty();
+    }
+
+    /// @brief Returns true if consumer has no events to pop.
+    bool empty() const
+    {
+        const uint64_t pos = m_header->tail.load(std::memory_order_relaxed);
+        return m_slots[pos & Mask].seq.load(std::memory_order_acquire) != pos + 1;
+    }
+
+private:
+    static constexpr uint64_t Magic = 0x7073692d736d7231; // "psi-smr1"
+    static constexpr uint64_t Mask = Capacity - 1;
+    static constexpr size_t CacheLine = 64;
+
+    struct Header {
+        std::atomic<uint64_t> magic {0};
+        uint32_t capacity = 0;
+        uint32_t eventSize = 0;
+
+        /// @brief position of next slot to be claimed by producers
+        alignas(CacheLine) std::atomic<uint64_t> head {0};
+
+        /// @brief position of next slot to be popped by consumer
+        alignas(CacheLine) std::atomic<uint64_t> tail {0};
+
+        /// @brief futex word, incremented by producers which wake consumer
+        alignas(CacheLine) std::atomic<uint32_t> wakeups {0};
+        std::atomic<uint32_t> sleeping {0};
+    };
+
+    struct Slot {
+        std::atomic<uint64_t> seq {0};
+        T event;
+    };
+
+    static constexpr size_t SlotsOffset = (sizeof(Header) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+    static constexpr size_t MappingSize = SlotsOffset + Capacity * sizeof(Slot);
+
+    ShmEventRing(void *mapping)
+        : m_header(static_cast<Header *>(mapping))
+        , m_slots(reinterpret_cast<Slot *>(static_cast<char *>(mapping) + SlotsOffset))
+    {
+    }
+
+    static std::unique_ptr<ShmEventRing> map(int fd)
+    {
+        void *mapping = ::mmap(nullptr, MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return nullptr;
+        }
+        return std::unique_ptr<ShmEventRing>(new ShmEventRing(mapping));
+    }
+
+    static void futex(std::atomic<uint32_t> *addr, int op, uint32_t value, const timespec *timeout)
+    {
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, value, timeout, nullptr, 0);
+    }
+
+    Header *m_header;
+    Slot *m_slots;
+
+    ShmEventRing(const ShmEventRing &) = delete;
+    ShmEventRing &operator=(const ShmEventRing &) = delete;
+};
+
+} // namespace psi::sm
+
+#endif
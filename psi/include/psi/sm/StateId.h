@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+namespace psi::sm {
+
+/// @brief Dense identifier of state type, unique among states of one state interface.
+using StateId = uint16_t;
+
+/// @brief Identifier used if state does not exist.
+constexpr StateId InvalidStateId = std::numeric_limits<StateId>::max();
+
+/**
+ * @brief StateIds assigns dense identifiers to state types of one state interface.
+ * Identifiers are assigned in order of first use and start from 0.
+ *
+ * @tparam IState
+ */
+template <typename IState>
+class StateIds
+{
+public:
+    /// @brief Returns identifier of state type.
+    template <typename State>
+    static StateId of()
+    {
+        static const StateId id = s_next.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    /// @brief Returns number of state types which got identifier.
+    static size_t count()
+    {
+        return s_next.load(std::memory_order_relaxed);
+    }
+
+private:
+    static inline std::atomic<StateId> s_next {0};
+};
+
+} // namespace psi::sm
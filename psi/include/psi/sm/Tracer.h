@@ -0,0 +1,411 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GNUG__)
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+
+#include "ProcessResult.h"
+
+namespace psi::sm::trace {
+
+/// @brief Kind of traced activity of context.
+enum class RecordType : uint8_t
+{
+    Event,   /// event processed by 'process_event'
+    Queue,   /// processing of posted and deferred events by 'process_queue'
+    Transit, /// transition to new state
+    Defer,   /// event is deferred
+    Post,    /// event is posted
+    Expire,  /// expired or cancelled event is dropped without reaction
+};
+
+/**
+ * @brief Record is a compact binary trace record.
+ * Names are type names with static storage duration, these are demangled by writer only.
+ */
+struct Record {
+    uint64_t begin;
+    uint64_t end;
+    const void *context;
+    const char *name;
+    const char *detail;
+    RecordType type;
+    ProcessResult result;
+};
+
+/**
+ * @brief ThreadBuffer is a bounded SPSC ring of records filled by one thread and drained by writer.
+ * Records are dropped if writer does not keep up.
+ */
+class ThreadBuffer
+{
+public:
+    static constexpr size_t Capacity = 1u << 14;
+
+    explicit ThreadBuffer(uint32_t tid)
+        : m_tid(tid)
+    {
+    }
+
+    uint32_t tid() const
+    {
+        return m_tid;
+    }
+
+    bool push(const Record &rec)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_records[head % Capacity] = rec;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename Fn>
+    size_t drain(Fn &&fn)
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t count = head - tail;
+        for (; tail != head; ++tail) {
+            fn(m_records[tail % Capacity]);
+        }
+        m_tail.store(tail, std::memory_order_release);
+        return count;
+    }
+
+private:
+    const uint32_t m_tid;
+    std::array<Record, Capacity> m_records;
+    alignas(64) std::atomic<size_t> m_head {0};
+    alignas(64) std::atomic<size_t> m_tail {0};
+};
+
+/**
+ * @brief Tracer records timeline of contexts and streams it as Chrome Trace Event JSON.
+ * The concept is:
+ * - hooks of @BaseContext are compiled only if PSI_SM_TRACE is defined for whole build (CMake option PSI_SM_TRACE),
+ *   defining it in some translation units only is not supported: BaseContext<IState> would differ between them
+ * - recording is enabled at runtime by 'start', every N-th top-level call of context is sampled
+ * - records are buffered per thread, background writer streams them to file
+ * Resulting file is opened by chrome://tracing or https://ui.perfetto.dev
+ */
+class Tracer
+{
+public:
+    static Tracer &instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    ~Tracer()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Starts recording.
+     *
+     * @param path path to output JSON file
+     * @param sampleEvery every N-th top-level call of context is recorded, 1 records everything
+     * @param flushPeriod period of writing buffered records to file
+     * @return true if output file is opened
+     */
+    bool start(const std::string &path,
+               uint32_t sampleEvery = 1,
+               std::chrono::milliseconds flushPeriod = std::chrono::milliseconds(100))
+    {
+        stop();
+
+        std::lock_guard<std::mutex> lock(m_writerMutex);
+        m_out.open(path, std::ios::out | std::ios::trunc);
+        if (!m_out) {
+            return false;
+        }
+        m_out << "{\"traceEvents\":[\n";
+        m_first = true;
+
+        m_sampleEvery.store(sampleEvery ? sampleEvery : 1, std::memory_order_relaxed);
+        m_dropped.store(0, std::memory_order_relaxed);
+        m_stopping = false;
+        m_writer = std::thread([this, flushPeriod]() {
+            std::unique_lock<std::mutex> lock(m_writerMutex);
+            while (!m_stopping) {
+                m_writerCv.wait_for(lock, flushPeriod);
+                flush();
+            }
+        });
+        m_enabled.store(true, std::memory_order_release);
+
+        return true;
+    }
+
+    /// @brief Stops recording, writes remaining records and closes file.
+    void stop()
+    {
+        if (!m_writer.joinable()) {
+            return;
+        }
+
+        m_enabled.store(false, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_writerMutex);
+            m_stopping = true;
+        }
+        m_writerCv.notify_one();
+        m_writer.join();
+
+        std::lock_guard<std::mutex> lock(m_writerMutex);
+        flush();
+        m_out << "\n]}\n";
+        m_out.close();
+    }
+
+    /// @brief Returns true if recording is started.
+    bool enabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns number of records lost due to full thread buffers.
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns true if next top-level call of calling thread has to be recorded.
+    bool sample()
+    {
+        thread_local uint32_t counter = 0;
+        if (++counter >= m_sampleEvery.load(std::memory_order_relaxed)) {
+            counter = 0;
+            return true;
+        }
+        return false;
+    }
+
+    /// @brief Stores record to buffer of calling thread.
+    void record(const Record &rec)
+    {
+        if (!buffer().push(rec)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief Returns current timestamp in nanoseconds.
+    static uint64_t now()
+    {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+    }
+
+private:
+    Tracer() = default;
+
+    ThreadBuffer &buffer()
+    {
+        thread_local std::shared_ptr<ThreadBuffer> buf;
+        if (!buf) {
+            std::lock_guard<std::mutex> lock(m_buffersMutex);
+            buf = std::make_shared<ThreadBuffer>(++m_lastTid);
+            m_buffers.emplace_back(buf);
+        }
+        return *buf;
+    }
+
+    /// @brief Writes buffered records to file, must be called under writer's lock.
+    void flush()
+    {
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        {
+            std::lock_guard<std::mutex> lock(m_buffersMutex);
+            buffers = m_buffers;
+        }
+
+        for (const auto &buf : buffers) {
+            buf->drain([&](const Record &rec) { write(buf->tid(), rec); });
+        }
+        buffers.clear();
+
+        // buffers of finished threads are owned by tracer only
+        {
+            std::lock_guard<std::mutex> lock(m_buffersMutex);
+            for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+                if (it->use_count() == 1) {
+                    (*it)->drain([&](const Record &rec) { write((*it)->tid(), rec); });
+                    it = m_buffers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        m_out.flush();
+    }
+
+    void write(uint32_t tid, const Record &rec)
+    {
+        static const char *const categories[] = {"event", "queue", "transit", "defer", "post", "expire"};
+
+        m_out << (m_first ? "" : ",\n") << "{\"name\":\"" << demangle(rec.name) << "\",\"cat\":\""
+              << categories[static_cast<size_t>(rec.type)] << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":"
+              << rec.begin / 1000 << '.' << rec.begin % 1000 / 100;
+        if (rec.type == RecordType::Event || rec.type == RecordType::Queue) {
+            const uint64_t dur = rec.end - rec.begin;
+            m_out << ",\"ph\":\"X\",\"dur\":" << dur / 1000 << '.' << dur % 1000 / 100;
+        } else {
+            m_out << ",\"ph\":\"i\",\"s\":\"t\"";
+        }
+        m_out << ",\"args\":{\"context\":\"" << rec.context << '"';
+        if (rec.type == RecordType::Event) {
+            m_out << ",\"result\":\"" << to_string(rec.result) << '"';
+        }
+        if (rec.detail) {
+            m_out << ",\"from\":\"" << demangle(rec.detail) << '"';
+        }
+        m_out << "}}";
+        m_first = false;
+    }
+
+    const std::string &demangle(const char *name)
+    {
+        auto it = m_names.find(name);
+        if (it != m_names.end()) {
+            return it->second;
+        }
+
+        std::string result = name;
+#if defined(__GNUG__)
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (status == 0 && demangled) {
+            result = demangled;
+        }
+        std::free(demangled);
+#endif
+        std::string escaped;
+        for (const char c : result) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+
+        return m_names.emplace(name, std::move(escaped)).first->second;
+    }
+
+    std::atomic<bool> m_enabled {false};
+    std::atomic<uint32_t> m_sampleEvery {1};
+    std::atomic<uint64_t> m_dropped {0};
+
+    std::mutex m_buffersMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    uint32_t m_lastTid = 0;
+
+    std::mutex m_writerMutex;
+    std::condition_variable m_writerCv;
+    std::thread m_writer;
+    bool m_stopping = false;
+    std::ofstream m_out;
+    bool m_first = true;
+    std::unordered_map<const char *, std::string> m_names;
+};
+
+namespace detail {
+
+/// @brief depth of nested traced calls and sampling decision of outermost one
+struct ThreadState {
+    uint32_t depth = 0;
+    bool sampled = false;
+};
+
+inline ThreadState &threadState()
+{
+    thread_local ThreadState state;
+    return state;
+}
+
+} // namespace detail
+
+/**
+ * @brief Scope records duration of context's activity.
+ * Outermost scope of thread decides whether the whole call is sampled.
+ */
+class Scope
+{
+public:
+    Scope(RecordType type, const void *context, const char *name)
+        : m_state(detail::threadState())
+    {
+        if (m_state.depth++ == 0) {
+            auto &tracer = Tracer::instance();
+            m_state.sampled = tracer.enabled() && tracer.sample();
+        }
+
+        if (m_state.sampled) {
+            m_record = Record {Tracer::now(), 0, context, name, nullptr, type, ProcessResult::UnconsumedEvent};
+        }
+    }
+
+    ~Scope()
+    {
+        if (m_state.sampled) {
+            m_record.end = Tracer::now();
+            Tracer::instance().record(m_record);
+        }
+        --m_state.depth;
+    }
+
+    void result(ProcessResult rs)
+    {
+        m_record.result = rs;
+    }
+
+private:
+    detail::ThreadState &m_state;
+    Record m_record {};
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+};
+
+/**
+ * @brief Records instant activity of context if current call is sampled.
+ *
+ * @param type type of activity
+ * @param context context object
+ * @param name type name of event or new state
+ * @param from type name of old state or nullptr
+ */
+inline void instant(RecordType type, const void *context, const char *name, const char *from = nullptr)
+{
+    auto &state = detail::threadState();
+    if (state.depth == 0) {
+        auto &tracer = Tracer::instance();
+        state.sampled = tracer.enabled() && tracer.sample();
+    }
+
+    if (state.sampled) {
+        const auto ts = Tracer::now();
+        Tracer::instance().record(Record {ts, ts, context, name, from, type, ProcessResult::UnconsumedEvent});
+    }
+}
+
+} // namespace psi::sm::trace
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BaseContext.h"
+#include "StateId.h"
+
+namespace psi::sm {
+
+/**
+ * @brief TransitionGraph is a live graph of transitions between state types.
+ * Nodes are state identifiers, edges carry number of transitions and time spent in source state before them.
+ * Edges are kept in matrix indexed by state identifiers (MaxStates^2 * 16 bytes), matrix is allocated on first
+ * transition between states, so contexts which never leave initial state do not pay for it.
+ * Afterwards counting transitions does not allocate, name of state is copied once, on first entry.
+ * Not thread-safe, owner is responsible for synchronization.
+ *
+ * @tparam MaxStates max number of state types, states with bigger identifiers are not recorded
+ */
+template <size_t MaxStates = 32>
+class TransitionGraph
+{
+public:
+    struct Edge {
+        /// @brief number of transitions
+        uint64_t hits = 0;
+
+        /// @brief cumulative time spent in source state before transitions, nanoseconds
+        uint64_t time = 0;
+    };
+
+    /**
+     * @brief Records transition.
+     *
+     * @param from identifier of old state, InvalidStateId if state is initialized
+     * @param to identifier of new state
+     * @param toName name of new state
+     * @param now timestamp of transition, nanoseconds
+     */
+    void record(StateId from, StateId to, const std::string &toName, uint64_t now)
+    {
+        if (to >= MaxStates || (from != InvalidStateId && from >= MaxStates)) {
+            ++m_overflow;
+            return;
+        }
+
+        if (m_names[to].empty()) {
+            m_names[to] = toName;
+        }
+
+        if (from != InvalidStateId) {
+            if (m_edges.empty()) {
+                m_edges.resize(MaxStates * MaxStates);
+            }
+            auto &e = m_edges[from * MaxStates + to];
+            ++e.hits;
+            e.time += now - m_enteredAt;
+        }
+        m_enteredAt = now;
+    }
+
+    /// @brief Returns edge between states, empty edge if it was not recorded.
+    const Edge &edge(StateId from, StateId to) const
+    {
+        static const Edge none;
+        return m_edges.empty() || from >= MaxStates || to >= MaxStates ? none : m_edges[from * MaxStates + to];
+    }
+
+    /// @brief Returns name of state or empty string if state was never entered or was not recorded.
+    const std::string &name(StateId id) const
+    {
+        static const std::string none;
+        return id < MaxStates ? m_names[id] : none;
+    }
+
+    /// @brief Returns number of transitions which were not recorded due to MaxStates limit.
+    uint64_t overflow() const
+    {
+        return m_overflow;
+    }
+
+    /// @brief Resets all counters, state names are kept.
+    void reset()
+    {
+        std::fill(m_edges.begin(), m_edges.end(), Edge {});
+        m_overflow = 0;
+    }
+
+    /**
+     * @brief Returns graph in Graphviz DOT format.
+     * Edge's label is 'hits / average time in source state, us'.
+     */
+    std::string toDot() const
+    {
+        std::ostringstream os;
+        os << "digraph transitions {\n";
+        for (size_t i = 0; i < MaxStates; ++i) {
+            if (!m_names[i].empty()) {
+                os << "    s" << i << " [label=\"";
+                escape(os, m_names[i]);
+                os << "\"];\n";
+            }
+        }
+        forEachEdge([&](size_t from, size_t to, const Edge &e) {
+            os << "    s" << from << " -> s" << to << " [label=\"" << e.hits << " / " << e.time / e.hits / 1000
+               << "us\"];\n";
+        });
+        os << "}\n";
+        return os.str();
+    }
+
+    /// @brief Returns graph in JSON format: {"states":[{"id","name"}],"edges":[{"from","to","hits","time_ns"}]}.
+    std::string toJson() const
+    {
+        std::ostringstream os;
+        os << "{\"states\":[";
+        bool first = true;
+        for (size_t i = 0; i < MaxStates; ++i) {
+            if (!m_names[i].empty()) {
+                os << (first ? "" : ",") << "{\"id\":" << i << ",\"name\":\"";
+                escape(os, m_names[i]);
+                os << "\"}";
+                first = false;
+            }
+        }
+        os << "],\"edges\":[";
+        first = true;
+        forEachEdge([&](size_t from, size_t to, const Edge &e) {
+            os << (first ? "" : ",") << "{\"from\":" << from << ",\"to\":" << to << ",\"hits\":" << e.hits
+               << ",\"time_ns\":" << e.time << "}";
+            first = false;
+        });
+        os << "]}";
+        return os.str();
+    }
+
+private:
+    /// @brief Writes string as content of quoted DOT or JSON string.
+    static void escape(std::ostream &os, const std::string &text)
+    {
+        for (const char c : text) {
+            switch (c) {
+            case '"':
+            case '\\':
+                os << '\\' << c;
+                break;
+            case '\n':
+                os << "\\n";
+                break;
+            default:
+                os << c;
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEachEdge(Fn &&fn) const
+    {
+        if (m_edges.empty()) {
+            return;
+        }
+        for (size_t from = 0; from < MaxStates; ++from) {
+            for (size_t to = 0; to < MaxStates; ++to) {
+                const auto &e = m_edges[from * MaxStates + to];
+                if (e.hits) {
+                    fn(from, to, e);
+                }
+            }
+        }
+    }
+
+    /// @brief matrix of edges, empty until first transition between states
+    std::vector<Edge> m_edges;
+    std::array<std::string, MaxStates> m_names {};
+    uint64_t m_enteredAt = 0;
+    uint64_t m_overflow = 0;
+};
+
+/**
+ * @brief GraphContext is a context recording its transitions into @TransitionGraph.
+ * Recording is enabled for all contexts of IState by @GraphObserver:
+ *
+ *      template <>
+ *      struct psi::sm::TransitionObserver<IMyState> : psi::sm::GraphObserver<IMyState> {};
+ *
+ * All contexts of IState must be derived from GraphContext<IState, MaxStates> then.
+ *
+ * @tparam IState
+ * @tparam MaxStates max number of state types
+ */
+template <typename IState, size_t MaxStates = 32>
+class GraphContext : public BaseContext<IState>
+{
+public:
+    using Graph = TransitionGraph<MaxStates>;
+
+    /// @brief Returns copy of current graph. Operation is thread-safe.
+    Graph transitionGraph()
+    {
+        std::lock_guard<typename BaseContext<IState>::Mutex> lock(this->m_mutex);
+        return m_graph;
+    }
+
+    /// @brief Returns current graph in DOT format. Operation is thread-safe.
+    std::string dumpDot()
+    {
+        std::lock_guard<typename BaseContext<IState>::Mutex> lock(this->m_mutex);
+        return m_graph.toDot();
+    }
+
+    /// @brief Returns current graph in JSON format. Operation is thread-safe.
+    std::string dumpJson()
+    {
+        std::lock_guard<typename BaseContext<IState>::Mutex> lock(this->m_mutex);
+        return m_graph.toJson();
+    }
+
+protected:
+    template <typename I, size_t N>
+    friend struct GraphObserver;
+
+    /// @brief graph of context's transitions, guarded by context's mutex
+    Graph m_graph;
+};
+
+/**
+ * @brief GraphObserver is a @TransitionObserver which records transitions into @GraphContext.
+ *
+ * @tparam IState
+ * @tparam MaxStates max number of state types, must match GraphContext
+ */
+template <typename IState, size_t MaxStates = 32>
+struct GraphObserver {
+    template <typename NewState>
+    static void on_transition(BaseContext<IState> &context, const IState *, const NewState &newState)
+    {
+        const auto now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                   std::chrono::steady_clock::now().time_since_epoch())
+                                                   .count());
+
+        auto &ctx = static_cast<GraphContext<IState, MaxStates> &>(context);
+        ctx.m_graph.record(context.currentStateId(), StateIds<IState>::template of<NewState>(), newState.name(), now);
+    }
+};
+
+} // namespace psi::sm
@@ -0,0 +1,43 @@
+#pragma once
+
+namespace psi::sm {
+
+template <typename T>
+class BaseContext;
+
+/**
+ * @brief TransitionObserver is a compile-time hook notified by context about every transition.
+ * Default observer does nothing and is fully inlined away.
+ * To observe transitions of contexts with specific IState specialize observer before first use of the context:
+ *
+ *      template <>
+ *      struct psi::sm::TransitionObserver<IMyState> {
+ *          template <typename NewState>
+ *          static void on_transition(BaseContext<IMyState> &, const IMyState *oldState, const NewState &newState);
+ *      };
+ *
+ * Observer is called under context's lock, after new state is created and before old state is destroyed.
+ * Observer must not perform transitions.
+ *
+ * @tparam IState
+ */
+template <typename IState>
+struct TransitionObserver {
+    /**
+     * @brief Called on every transition of context.
+     *
+     * @tparam NewState type of new state
+     * @param context context performing transition
+     * @param oldState pointer to current state, nullptr if state is initialized
+     * @param newState new state object
+     */
+    template <typename NewState>
+    static void on_transition(BaseContext<IState> &context, const IState *oldState, const NewState &newState)
+    {
+        (void)context;
+        (void)oldState;
+        (void)newState;
+    }
+};
+
+} // namespace psi::sm
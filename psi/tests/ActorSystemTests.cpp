@@ -0,0 +1,197 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "psi/sm/ActorSystem.h"
+#include "psi/sm/BaseState.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class ActorSystemTests : public Test
+{
+public:
+    /// @brief counts copies of objects containing it
+    struct CopyCounter {
+        static inline int copies = 0;
+
+        CopyCounter() = default;
+
+        CopyCounter(const CopyCounter &)
+        {
+            ++copies;
+        }
+
+        CopyCounter &operator=(const CopyCounter &)
+        {
+            ++copies;
+            return *this;
+        }
+    };
+
+    struct EvPing {
+        int value;
+        CopyCounter counter {};
+    };
+
+    struct IReceiverState {
+        virtual ~IReceiverState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvPing &) = 0;
+    };
+
+    struct ISenderState {
+        virtual ~ISenderState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvPing &) = 0;
+    };
+
+    struct ReceiverContext : ActorContext<IReceiverState> {
+        using ActorContext<IReceiverState>::ActorContext;
+
+        /// @brief addresses of received events, taken while events are alive
+        std::vector<uintptr_t> received;
+        std::vector<int> values;
+    };
+
+    struct ReceiverState : BaseState<IReceiverState> {
+        ReceiverState()
+            : BaseState<IReceiverState>("ReceiverState")
+        {
+        }
+
+        ProcessResult react(const EvPing &ev) override
+        {
+            context<ReceiverContext>()->received.emplace_back(reinterpret_cast<uintptr_t>(&ev));
+            context<ReceiverContext>()->values.emplace_back(ev.value);
+            return discard_event();
+        }
+    };
+
+    struct SenderContext : ActorContext<ISenderState> {
+        using ActorContext<ISenderState>::ActorContext;
+
+        std::vector<psi::sm::Address<IReceiverState>> receivers;
+    };
+
+    struct SenderState : BaseState<ISenderState> {
+        SenderState()
+            : BaseState<ISenderState>("SenderState")
+        {
+        }
+
+        ProcessResult react(const EvPing &ev) override
+        {
+            auto ctx = context<SenderContext>();
+            ctx->send(ctx->receivers, ev);
+            return discard_event();
+        }
+    };
+};
+
+TEST_F(ActorSystemTests, send)
+{
+    ActorSystem system(2);
+    ReceiverContext receiver(system);
+    receiver.transit<ReceiverState>();
+
+    {
+        SCOPED_TRACE("// case 1. message is delivered on dispatch only");
+
+        system.send(receiver.address(), EvPing {1});
+        EXPECT_EQ(receiver.received.empty(), true);
+
+        EXPECT_EQ(system.dispatch(), 1u);
+        ASSERT_EQ(receiver.received.size(), 1u);
+        EXPECT_EQ(receiver.values.front(), 1);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. messages to destroyed actor are dropped");
+
+        psi::sm::Address<IReceiverState> addr;
+        {
+            ReceiverContext temporary(system);
+            temporary.transit<ReceiverState>();
+            addr = temporary.address();
+        }
+        system.send(addr, EvPing {2});
+        EXPECT_EQ(system.dispatch(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. messages to address of another state interface are dropped");
+
+        system.send(psi::sm::Address<ISenderState> {receiver.address().id}, EvPing {3});
+        EXPECT_EQ(system.dispatch(), 0u);
+        EXPECT_EQ(receiver.values.size(), 1u);
+    }
+}
+
+TEST_F(ActorSystemTests, fan_out)
+{
+    ActorSystem system(2);
+
+    std::vector<std::unique_ptr<ReceiverContext>> receivers;
+    SenderContext sender(system);
+    sender.transit<SenderState>();
+    for (int i = 0; i < 5; ++i) {
+        receivers.emplace_back(std::make_unique<ReceiverContext>(system));
+        receivers.back()->transit<ReceiverState>();
+        sender.receivers.emplace_back(receivers.back()->address());
+    }
+
+    // event is copied into shared event once, receivers get the same object
+    const EvPing ping {42};
+    const int copies = CopyCounter::copies;
+    sender.process_event(ping);
+    EXPECT_EQ(system.dispatch(), 0u);
+
+    sender.flush();
+    EXPECT_EQ(system.dispatch(), 5u);
+    EXPECT_EQ(CopyCounter::copies, copies + 1);
+
+    const uintptr_t shared = receivers.front()->received.front();
+    for (const auto &receiver : receivers) {
+        ASSERT_EQ(receiver->received.size(), 1u);
+        EXPECT_EQ(receiver->received.front(), shared);
+        EXPECT_EQ(receiver->values.front(), 42);
+    }
+}
+
+TEST_F(ActorSystemTests, shared_event)
+{
+    struct ITestState {
+        virtual ~ITestState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvPing &) = 0;
+    };
+
+    struct DeferState : BaseState<ITestState> {
+        DeferState()
+            : BaseState<ITestState>("DeferState")
+        {
+        }
+
+        ProcessResult react(const EvPing &) override
+        {
+            return defer_event();
+        }
+    };
+
+    struct TestContext : BaseContext<ITestState> {
+    };
+
+    TestContext context;
+    context.transit<DeferState>();
+
+    auto ev = make_shared_event<EvPing>(EvPing {7});
+    context.process_event(ev);
+    EXPECT_EQ(ev.use_count(), 2);
+}
@@ -3,8 +3,17 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 #include "psi/sm/BaseContext.h"
 #include "psi/sm/BaseState.h"
+#include "psi/sm/ExpiringEvent.h"
+#include "psi/sm/RequestEvent.h"
 
 using namespace ::testing;
 using namespace psi::sm;
@@ -28,6 +37,8 @@ public:
     };
 
     struct TestContext : BaseContext<ITestState> {
+        using BaseContext<ITestState>::BaseContext;
+        using BaseContext<ITestState>::queueSize;
     };
 
     struct TestState1 : BaseState<ITestState> {
@@ -43,6 +54,39 @@ public:
         {
         }
     };
+
+    struct TrackedState : BaseState<ITestState> {
+        TrackedState()
+            : BaseState<ITestState>("TrackedState")
+        {
+        }
+
+        ~TrackedState() override
+        {
+            ++destroyed;
+        }
+
+        static inline int destroyed = 0;
+    };
+
+    struct FilteringState : BaseState<ITestState> {
+        FilteringState()
+            : BaseState<ITestState>("FilteringState")
+        {
+        }
+
+        using HandledEvents = EventList<>;
+    };
+
+    struct DeferringState : BaseState<ITestState> {
+        DeferringState()
+            : BaseState<ITestState>("DeferringState")
+        {
+        }
+
+        using HandledEvents = EventList<EvTest>;
+        using DeferredEvents = EventList<EvTest>;
+    };
 };
 
 TEST_F(BaseContextTests, process_event)
@@ -50,14 +94,14 @@ TEST_F(BaseContextTests, process_event)
     struct TestContext_PartlyMocked : TestContext {
         MOCK_METHOD(void, process_queue, (), ());
 
-        const std::deque<Func> &deferred()
+        const FuncQueue &deferred()
         {
-            return m_deferred;
+            return queues().deferred;
         }
 
-        const std::deque<Func> &posted()
+        const FuncQueue &posted()
         {
-            return m_posted;
+            return queues().posted;
         }
     };
     StrictMock<TestContext_PartlyMocked> context;
@@ -132,9 +176,9 @@ TEST_F(BaseContextTests, post_event)
     struct TestContext_PartlyMocked : TestContext {
         MOCK_METHOD(void, process_queue, (), ());
 
-        const std::deque<Func> &posted()
+        const FuncQueue &posted()
         {
-            return m_posted;
+            return queues().posted;
         }
     };
     StrictMock<TestContext_PartlyMocked> context;
@@ -210,6 +254,521 @@ TEST_F(BaseContextTests, process_queue)
         // context.process_queue();
     }
 }
+
+TEST_F(BaseContextTests, queues)
+{
+    struct TestContext_Queues : TestContext {
+        bool hasQueues() const
+        {
+            return m_queues != nullptr;
+        }
+    };
+    TestContext_Queues context;
+
+    {
+        SCOPED_TRACE("// case 1. idle context has no queues");
+
+        context.transit<StrictMock<TestState1>>();
+        EXPECT_EQ(context.hasQueues(), false);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. queues are allocated by deferred event");
+
+        EvTest ev;
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::DeferredEvent));
+        context.process_event(ev);
+        EXPECT_EQ(context.hasQueues(), true);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. queues are released when drained");
+
+        context.transit<NiceMock<TestState2>>();
+        EXPECT_EQ(context.hasQueues(), false);
+    }
+}
+
+TEST_F(BaseContextTests, memory_resource)
+{
+    struct CountingResource : std::pmr::memory_resource {
+        size_t allocated = 0;
+        size_t deallocated = 0;
+
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            allocated += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override
+        {
+            deallocated += bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+    CountingResource resource;
+
+    {
+        TestContext context(&resource);
+        EXPECT_EQ(context.memoryResource(), &resource);
+
+        context.transit<StrictMock<TestState1>>();
+        EXPECT_EQ(resource.allocated, sizeof(StrictMock<TestState1>));
+
+        EvTest ev;
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::DeferredEvent));
+        context.process_event(ev);
+        EXPECT_GT(resource.allocated, sizeof(StrictMock<TestState1>));
+
+        context.transit<NiceMock<TestState2>>();
+        EXPECT_EQ(resource.allocated - resource.deallocated, sizeof(NiceMock<TestState2>));
+    }
+
+    EXPECT_EQ(resource.allocated, resource.deallocated);
+}
+
+TEST_F(BaseContextTests, observeState)
+{
+    TestContext context;
+    TrackedState::destroyed = 0;
+
+    {
+        SCOPED_TRACE("// case 1. state not exists");
+
+        EXPECT_EQ(context.observeState([](const ITestState *st) { return st; }), nullptr);
+        EXPECT_EQ(context.currentStateId(), InvalidStateId);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. observed state is kept until observer returns");
+
+        context.transit<TrackedState>();
+        context.observeState([&](const ITestState *st) {
+            context.transit<NiceMock<TestState1>>();
+            EXPECT_EQ(TrackedState::destroyed, 0);
+            EXPECT_EQ(st->name(), "TrackedState");
+            return 0;
+        });
+        EXPECT_EQ(TrackedState::destroyed, 0);
+
+        context.transit<NiceMock<TestState2>>();
+        EXPECT_EQ(TrackedState::destroyed, 1);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. not observed state is destroyed on transition");
+
+        context.transit<TrackedState>();
+        context.transit<NiceMock<TestState1>>();
+        EXPECT_EQ(TrackedState::destroyed, 2);
+    }
+
+    {
+        SCOPED_TRACE("// case 4. too deep nesting of observers throws");
+
+        const auto observe = [&](auto &self, int depth) -> int {
+            return context.observeState([&](const ITestState *) { return depth ? self(self, depth - 1) : 0; });
+        };
+        EXPECT_EQ(observe(observe, HazardDomain::SlotsPerRecord - 1), 0);
+        EXPECT_THROW(observe(observe, HazardDomain::SlotsPerRecord), std::length_error);
+        EXPECT_EQ(observe(observe, 0), 0);
+    }
+
+    {
+        SCOPED_TRACE("// case 5. number of observing threads is not limited");
+
+        constexpr size_t threads = 200;
+        std::atomic<size_t> inside {0};
+        std::atomic<size_t> seen {0};
+        std::vector<std::thread> observers;
+        for (size_t i = 0; i < threads; ++i) {
+            observers.emplace_back([&]() {
+                context.observeState([&](const ITestState *st) {
+                    seen += st != nullptr;
+                    ++inside;
+                    while (inside.load() < threads) {
+                        std::this_thread::yield();
+                    }
+                    return 0;
+                });
+            });
+        }
+        for (auto &t : observers) {
+            t.join();
+        }
+        EXPECT_EQ(seen.load(), threads);
+    }
+}
+
+TEST_F(BaseContextTests, observeState_concurrent)
+{
+    TestContext context;
+    context.transit<NiceMock<TestState1>>();
+
+    std::atomic<bool> stop {false};
+    size_t observed = 0;
+    std::thread observer([&]() {
+        while (!stop.load()) {
+            observed += context.observeState([](const ITestState *st) { return st->name().size(); });
+        }
+    });
+
+    for (int i = 0; i < 1000; ++i) {
+        context.transit<NiceMock<TestState2>>();
+        context.transit<NiceMock<TestState1>>();
+    }
+    stop = true;
+    observer.join();
+
+    EXPECT_GT(observed, 0u);
+    EXPECT_EQ(context.observeState([](const ITestState *st) { return st->name(); }), "TestState1");
+}
+
+TEST_F(BaseContextTests, expiring_events)
+{
+    TestContext context;
+    context.transit<StrictMock<TestState1>>();
+
+    EvTest ev;
+    auto token = CancelToken::create();
+    const auto expiring = make_expiring_event(ev, std::chrono::hours(1));
+    const auto expired = make_expiring_event(ev, std::chrono::hours(-1));
+    const auto cancellable = make_cancellable_event(ev, token);
+
+    {
+        SCOPED_TRACE("// case 1. expired event is not reacted");
+
+        context.process_event(expired);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. alive events are reacted and deferred");
+
+        EXPECT_CALL(*context.currentState().value(), react(ev))
+            .Times(2)
+            .WillRepeatedly(Return(ProcessResult::DeferredEvent));
+        context.process_event(expiring);
+        context.process_event(cancellable);
+        EXPECT_EQ(context.queueSize(), 2u);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. cancelled event is dropped on re-processing");
+
+        token.cancel();
+        EXPECT_EQ(is_expired(cancellable), true);
+
+        context.transit<NiceMock<TestState2>>();
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 4. expired events are purged without transition");
+
+        context.transit<StrictMock<TestState1>>();
+        auto other = CancelToken::create();
+        EXPECT_CALL(*context.currentState().value(), react(ev))
+            .Times(3)
+            .WillRepeatedly(Return(ProcessResult::DeferredEvent));
+        context.process_event(make_cancellable_event(ev, other));
+        context.process_event(make_cancellable_event(ev, other));
+        context.process_event(ev);
+        EXPECT_EQ(context.purge_expired(), 0u);
+
+        other.cancel();
+        EXPECT_EQ(context.purge_expired(), 2u);
+        EXPECT_EQ(context.queueSize(), 1u);
+        context.cancel_deferred<EvTest>([](const EvTest &) { return true; });
+    }
+
+    {
+        SCOPED_TRACE("// case 5. deferred queue of context which never transits stays bounded");
+
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillRepeatedly(Return(ProcessResult::DeferredEvent));
+        for (int i = 0; i < 1000; ++i) {
+            auto shortLived = CancelToken::create();
+            context.process_event(make_cancellable_event(ev, shortLived));
+            shortLived.cancel();
+        }
+        EXPECT_LE(context.queueSize(), 2 * TestContext::MinPurgeSize);
+        EXPECT_GT(context.purge_expired(), 0u);
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 6. expired request completes with invalid state");
+
+        auto future = context.request_event(expired);
+        ASSERT_TRUE(future.ready());
+        EXPECT_EQ(future.wait().result, ProcessResult::DiscardedEvent);
+        EXPECT_EQ(future.wait().state, InvalidStateId);
+
+        auto purged = CancelToken::create();
+        future = context.request_event(make_cancellable_event(ev, purged));
+        EXPECT_FALSE(future.ready());
+        purged.cancel();
+        EXPECT_EQ(context.purge_expired(), 1u);
+        ASSERT_TRUE(future.ready());
+        EXPECT_EQ(future.wait().state, InvalidStateId);
+    }
+
+    context.transit<NiceMock<TestState2>>();
+}
+
+TEST_F(BaseContextTests, cancel_deferred)
+{
+    TestContext context;
+    context.transit<StrictMock<TestState1>>();
+
+    EvTest ev;
+    EXPECT_CALL(*context.currentState().value(), react(ev))
+        .Times(3)
+        .WillRepeatedly(Return(ProcessResult::DeferredEvent));
+    context.process_event(ev);
+    context.process_event(make_shared_event<EvTest>());
+    context.process_event(make_expiring_event(ev, std::chrono::hours(1)));
+    EXPECT_EQ(context.queueSize(), 3u);
+
+    {
+        SCOPED_TRACE("// case 1. nothing matches");
+
+        EXPECT_EQ(context.cancel_deferred<int>([](const int &) { return true; }), 0u);
+        EXPECT_EQ(context.cancel_deferred<EvTest>([](const EvTest &) { return false; }), 0u);
+        EXPECT_EQ(context.queueSize(), 3u);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. events of all kinds are removed");
+
+        EXPECT_EQ(context.cancel_deferred<EvTest>([](const EvTest &) { return true; }), 3u);
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+
+    context.transit<StrictMock<TestState2>>();
+}
+
+TEST_F(BaseContextTests, reentrant_process_event)
+{
+    TestContext context;
+    context.transit<StrictMock<TestState1>>();
+
+    EvTest ev;
+    int depth = 0;
+    int maxDepth = 0;
+    int calls = 0;
+
+    {
+        SCOPED_TRACE("// case 1. event processed by state is queued and processed after reaction");
+
+        EXPECT_CALL(*context.currentState().value(), react(ev)).Times(3).WillRepeatedly(Invoke([&](const EvTest &e) {
+            maxDepth = std::max(maxDepth, ++depth);
+            if (++calls < 3) {
+                context.process_event(e);
+                EXPECT_EQ(context.queueSize(), 1u);
+            }
+            --depth;
+            return ProcessResult::DiscardedEvent;
+        }));
+        context.process_event(ev);
+
+        EXPECT_EQ(calls, 3);
+        EXPECT_EQ(maxDepth, 1);
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. transition during reaction processes queue after reaction");
+
+        EXPECT_CALL(*context.currentState().value(), react(ev))
+            .WillOnce(Return(ProcessResult::DeferredEvent))
+            .WillOnce(Invoke([&](const EvTest &) {
+                context.transit<NiceMock<TestState2>>();
+                EXPECT_EQ(context.queueSize(), 1u);
+                return ProcessResult::DiscardedEvent;
+            }));
+        context.process_event(ev);
+        context.process_event(ev);
+
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+}
+
+TEST_F(BaseContextTests, request_event)
+{
+    TestContext context;
+    context.transit<StrictMock<TestState1>>();
+    const auto state1 = context.currentStateId();
+
+    EvTest ev;
+
+    {
+        SCOPED_TRACE("// case 1. future completes by reaction");
+
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::UnconsumedEvent));
+        auto future = context.request_event(ev);
+
+        ASSERT_TRUE(future.valid());
+        EXPECT_TRUE(future.ready());
+        const auto rs = future.wait();
+        EXPECT_EQ(rs.result, ProcessResult::UnconsumedEvent);
+        EXPECT_EQ(rs.state, state1);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. deferred event completes once it is re-processed by next state");
+
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::DeferredEvent));
+        auto future = context.request_event(ev);
+
+        EXPECT_FALSE(future.ready());
+        EXPECT_FALSE(future.wait_for(std::chrono::milliseconds(1)).has_value());
+
+        DefaultValue<ProcessResult>::Set(ProcessResult::UnconsumedEvent);
+        context.transit<NiceMock<TestState2>>();
+        DefaultValue<ProcessResult>::Clear();
+
+        const auto rs = future.wait_for(std::chrono::seconds(1));
+        ASSERT_TRUE(rs.has_value());
+        EXPECT_EQ(rs->result, ProcessResult::UnconsumedEvent);
+        EXPECT_EQ(rs->state, context.currentStateId());
+        EXPECT_NE(rs->state, state1);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. cancelled event completes as discarded");
+
+        context.transit<StrictMock<TestState1>>();
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::DeferredEvent));
+        auto future = context.request_event(ev);
+        EXPECT_EQ(context.cancel_deferred<EvTest>([](const EvTest &) { return true; }), 1u);
+
+        ASSERT_TRUE(future.ready());
+        EXPECT_EQ(future.wait().result, ProcessResult::DiscardedEvent);
+        EXPECT_EQ(future.wait().state, InvalidStateId);
+    }
+
+    {
+        SCOPED_TRACE("// case 4. queued event completes as discarded when context is destroyed");
+
+        RequestFuture future;
+        {
+            TestContext other;
+            other.transit<StrictMock<TestState1>>();
+            EXPECT_CALL(*other.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::DeferredEvent));
+            future = other.request_event(ev);
+            EXPECT_FALSE(future.ready());
+        }
+        EXPECT_EQ(future.wait().result, ProcessResult::DiscardedEvent);
+    }
+
+    {
+        SCOPED_TRACE("// case 5. completions are reused");
+
+        const auto capacity = detail::CompletionPool::instance().capacity();
+        EXPECT_CALL(*context.currentState().value(), react(ev))
+            .Times(3 * detail::CompletionPool::ChunkSize)
+            .WillRepeatedly(Return(ProcessResult::UnconsumedEvent));
+        for (size_t i = 0; i < 3 * detail::CompletionPool::ChunkSize; ++i) {
+            EXPECT_EQ(context.request_event(ev).wait().result, ProcessResult::UnconsumedEvent);
+        }
+        EXPECT_EQ(detail::CompletionPool::instance().capacity(), capacity);
+    }
+}
+
+TEST_F(BaseContextTests, request_event_concurrent)
+{
+    TestContext context;
+    context.transit<NiceMock<TestState1>>();
+
+    EvTest ev;
+    ON_CALL(*context.currentState().value(), react(ev)).WillByDefault(Return(ProcessResult::DeferredEvent));
+
+    std::vector<RequestFuture> futures;
+    for (int i = 0; i < 16; ++i) {
+        futures.emplace_back(context.request_event(ev));
+    }
+
+    std::atomic<int> completed {0};
+    std::vector<std::thread> waiters;
+    for (auto &future : futures) {
+        waiters.emplace_back([&completed, &future]() {
+            if (future.wait().result == ProcessResult::UnconsumedEvent) {
+                ++completed;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    DefaultValue<ProcessResult>::Set(ProcessResult::UnconsumedEvent);
+    context.transit<NiceMock<TestState2>>();
+    DefaultValue<ProcessResult>::Clear();
+
+    for (auto &waiter : waiters) {
+        waiter.join();
+    }
+    EXPECT_EQ(completed.load(), 16);
+}
+
+TEST_F(BaseContextTests, event_filter)
+{
+    TestContext context;
+    EvTest ev;
+
+    {
+        SCOPED_TRACE("// case 1. event which is not handled by state is unconsumed without reaction");
+
+        context.transit<StrictMock<FilteringState>>();
+        context.process_event(ev);
+        context.process_event(make_shared_event<EvTest>());
+        EXPECT_EQ(context.request_event(ev).wait().result, ProcessResult::UnconsumedEvent);
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. event deferred by declaration is queued without reaction");
+
+        context.transit<StrictMock<DeferringState>>();
+        context.process_event(ev);
+        context.process_event(make_expiring_event(ev, std::chrono::hours(1)));
+        EXPECT_EQ(context.queueSize(), 2u);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. state without declarations reacts on deferred events");
+
+        DefaultValue<ProcessResult>::Set(ProcessResult::DiscardedEvent);
+        context.transit<NiceMock<TestState2>>();
+        DefaultValue<ProcessResult>::Clear();
+        EXPECT_EQ(context.queueSize(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 4. event sent to busy context is not dropped by stale state");
+
+        context.transit<StrictMock<FilteringState>>();
+        context.mutex().lock();
+
+        RequestResult rs;
+        std::thread sender([&]() { rs = context.request_event(ev).wait(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        // owner of lock changes state before event is processed
+        context.transit<StrictMock<TestState1>>();
+        EXPECT_CALL(*context.currentState().value(), react(ev)).WillOnce(Return(ProcessResult::DiscardedEvent));
+        context.mutex().unlock();
+        sender.join();
+
+        EXPECT_EQ(rs.result, ProcessResult::DiscardedEvent);
+        EXPECT_EQ(rs.state, context.currentStateId());
+    }
+}
+
 // virtual void process_queue()
 //     {
 //         m_queue.insert(m_queue.begin(), m_posted.begin(), m_posted.end());
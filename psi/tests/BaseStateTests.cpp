@@ -36,9 +36,9 @@ public:
     };
 
     struct TestContext : BaseContext<ITestState> {
-        const std::deque<Func> &posted()
+        const FuncQueue &posted()
         {
-            return m_posted;
+            return queues().posted;
         }
     };
 
@@ -93,6 +93,20 @@ public:
             return BaseState<ITestState>::transit<NextState>(postEvent);
         }
     };
+
+    struct HookedState : TestState {
+        static inline std::vector<std::string> hooks;
+
+        void on_entry()
+        {
+            hooks.emplace_back("entry");
+        }
+
+        void on_exit()
+        {
+            hooks.emplace_back("exit");
+        }
+    };
 };
 
 TEST_F(BaseStateTests, name)
@@ -160,3 +174,31 @@ TEST_F(BaseStateTests, post_event)
 
     EXPECT_EQ(context.posted().empty(), false);
 }
+
+TEST_F(BaseStateTests, on_entry_on_exit)
+{
+    StrictMock<TestContext> context;
+    HookedState::hooks.clear();
+
+    {
+        SCOPED_TRACE("// case 1. hooks are not declared by state");
+
+        context.transit<TestState>();
+        EXPECT_EQ(HookedState::hooks.empty(), true);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. entry hook is called after state became current");
+
+        context.transit<HookedState>();
+        EXPECT_EQ(HookedState::hooks, std::vector<std::string>({"entry"}));
+    }
+
+    {
+        SCOPED_TRACE("// case 3. exit hook is called on leaving state");
+
+        context.transit<AnotherState>();
+        EXPECT_EQ(HookedState::hooks, std::vector<std::string>({"entry", "exit"}));
+        EXPECT_EQ(context.currentState().value()->name(), "AnotherState");
+    }
+}
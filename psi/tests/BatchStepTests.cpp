@@ -0,0 +1,106 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "psi/sm/BatchStep.h"
+#include "psi/sm/FlyweightEngine.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class BatchStepTests : public Test
+{
+public:
+    static std::vector<StepKernel> supportedKernels()
+    {
+        std::vector<StepKernel> kernels {StepKernel::Scalar};
+        if (bestStepKernel() != StepKernel::Scalar) {
+            kernels.emplace_back(StepKernel::Ssse3);
+        }
+        if (bestStepKernel() == StepKernel::Avx2) {
+            kernels.emplace_back(StepKernel::Avx2);
+        }
+        return kernels;
+    }
+
+    template <size_t NumStates>
+    static void checkKernels(size_t count)
+    {
+        std::mt19937 rng(static_cast<uint32_t>(NumStates * 1000 + count));
+        std::uniform_int_distribution<int> dist(0, NumStates - 1);
+
+        TransitionTable<NumStates> table;
+        for (size_t i = 0; i < NumStates; i += 3) {
+            table.set(static_cast<uint8_t>(i), static_cast<uint8_t>(dist(rng)));
+        }
+
+        std::vector<uint8_t> input(count);
+        for (auto &st : input) {
+            st = static_cast<uint8_t>(dist(rng));
+        }
+
+        std::vector<uint8_t> expected = input;
+        std::vector<uint32_t> expectedChanged;
+        for (size_t i = 0; i < count; ++i) {
+            const auto next = table.next(expected[i]);
+            if (next != expected[i]) {
+                expected[i] = next;
+                expectedChanged.emplace_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        for (const auto kernel : supportedKernels()) {
+            SCOPED_TRACE("kernel " + std::to_string(static_cast<int>(kernel)) + ", states "
+                         + std::to_string(NumStates) + ", machines " + std::to_string(count));
+
+            auto states = input;
+            std::vector<uint32_t> changed;
+            EXPECT_EQ(batch_step(states.data(), states.size(), table, &changed, kernel), expectedChanged.size());
+            EXPECT_EQ(states, expected);
+            EXPECT_EQ(changed, expectedChanged);
+
+            states = input;
+            EXPECT_EQ(batch_step(states.data(), states.size(), table, nullptr, kernel), expectedChanged.size());
+            EXPECT_EQ(states, expected);
+        }
+    }
+};
+
+TEST_F(BatchStepTests, batch_step)
+{
+    for (const size_t count : {0u, 1u, 15u, 16u, 33u, 100u, 4099u}) {
+        checkKernels<2>(count);
+        checkKernels<16>(count);
+        checkKernels<17>(count);
+        checkKernels<32>(count);
+        checkKernels<40>(count);
+    }
+}
+
+TEST_F(BatchStepTests, step_all)
+{
+    struct Running {
+    };
+    struct Halted {
+    };
+    using Engine = FlyweightEngine<StateList<Running, Halted>>;
+
+    Engine engine;
+    for (int i = 0; i < 100; ++i) {
+        i % 4 ? engine.create<Running>() : engine.create<Halted>();
+    }
+
+    TransitionTable<2> halt;
+    halt.set(Engine::stateIndex<Running>(), Engine::stateIndex<Halted>());
+
+    std::vector<Engine::MachineId> changed;
+    EXPECT_EQ(engine.step_all(halt, &changed), 75u);
+    EXPECT_EQ(engine.count<Halted>(), 100u);
+    ASSERT_EQ(changed.size(), 75u);
+    EXPECT_EQ(changed.front(), 1u);
+    EXPECT_EQ(changed.back(), 99u);
+
+    EXPECT_EQ(engine.step_all(halt), 0u);
+}
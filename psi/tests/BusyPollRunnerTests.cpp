@@ -0,0 +1,488 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+#include "psi/sm/BusyPollRunner.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class BusyPollRunnerTests : public Test
+{
+public:
+    struct EvValue {
+        uint32_t producer;
+        uint32_t value;
+    };
+
+    struct IRunnerState {
+        virtual ~IRunnerState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvValue &) = 0;
+    };
+
+    struct RunnerContext : BaseContext<IRunnerState> {
+        std::vector<std::vector<uint32_t>> received {4};
+        std::thread::id reactor;
+    };
+
+    struct RunnerState : BaseState<IRunnerState> {
+        RunnerState()
+            : BaseState<IRunnerState>("RunnerState")
+        {
+        }
+
+        ProcessResult react(const EvValue &ev) override
+        {
+            auto *ctx = context<RunnerContext>();
+            ctx->received[ev.producer].emplace_back(ev.value);
+            ctx->reactor = std::this_thread::get_id();
+            return discard_event();
+        }
+    };
+};
+
+TEST_F(BusyPollRunnerTests, send)
+{
+    RunnerContext context;
+    context.transit<RunnerState>();
+
+    BusyPollRunner<64>::Config config;
+    config.spins = 16;
+    config.yields = 4;
+    BusyPollRunner<64> runner(config);
+    runner.attach(context);
+    ASSERT_EQ(runner.start(), true);
+    EXPECT_EQ(runner.start(), false);
+
+    constexpr uint32_t count = 10000;
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < 4; ++p) {
+        producers.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < count; ++i) {
+                runner.send(context, EvValue {p, i});
+            }
+        });
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+
+    std::atomic<bool> executed {false};
+    while (!runner.try_execute([&]() { executed = true; })) {
+    }
+
+    runner.stop();
+    EXPECT_EQ(runner.running(), false);
+    EXPECT_EQ(executed.load(), true);
+    EXPECT_NE(context.reactor, std::this_thread::get_id());
+
+    for (const auto &values : context.received) {
+        ASSERT_EQ(values.size(), count);
+        for (uint32_t i = 0; i < count; ++i) {
+            EXPECT_EQ(values[i], i);
+        }
+    }
+}
+
+TEST_F(BusyPollRunnerTests, park)
+{
+    RunnerContext context;
+    context.transit<RunnerState>();
+
+    BusyPollRunner<8>::Config config;
+    config.spins = 1;
+    config.yields = 1;
+    BusyPollRunner<8> runner(config);
+    runner.attach(context);
+    runner.start();
+
+    while (!runner.parks()) {
+        std::this_thread::yield();
+    }
+
+    {
+        SCOPED_TRACE("// case 1. parked runner is woken up by send");
+
+        EXPECT_EQ(runner.try_send(context, EvValue {0, 7}), true);
+        std::atomic<bool> done {false};
+        while (!runner.try_execute([&]() { done = true; })) {
+        }
+        while (!done) {
+            std::this_thread::yield();
+        }
+        runner.stop();
+        ASSERT_EQ(context.received[0].size(), 1u);
+        EXPECT_EQ(context.received[0][0], 7u);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. context is released by stopped runner");
+
+        context.process_event(EvValue {1, 8});
+        ASSERT_EQ(context.received[1].size(), 1u);
+    }
+}
+
+TEST_F(BusyPollRunnerTests, destroy)
+{
+    auto payload = std::make_shared<int>(1);
+
+    {
+        SCOPED_TRACE("// case 1. tasks sent to stopped runner are destroyed with it");
+
+        BusyPollRunner<8> runner;
+        EXPECT_EQ(runner.try_execute([payload]() { ++*payload; }), true);
+        EXPECT_EQ(runner.try_execute([payload]() { ++*payload; }), true);
+        EXPECT_EQ(payload.use_count(), 3);
+    }
+    EXPECT_EQ(payload.use_count(), 1);
+    EXPECT_EQ(*payload, 1);
+
+    {
+        SCOPED_TRACE("// case 2. failure of pinning is reported");
+
+        BusyPollRunner<8>::Config config;
+        config.cpu = CPU_SETSIZE;
+        BusyPollRunner<8> runner(config);
+        ASSERT_EQ(runner.start(), true);
+        EXPECT_EQ(runner.pinError(), EINVAL);
+        runner.stop();
+
+        BusyPollRunner<8> unpinned;
+        unpinned.start();
+        EXPECT_EQ(unpinned.pinError(), 0);
+    }
+}
+
+TEST_F(BusyPollRunnerTests, migrate)
+{
+    RunnerContext context;
+    context.transit<RunnerState>();
+
+    BusyPollRunner<64>::Config config;
+    config.spins = 16;
+    config.yields = 4;
+    BusyPollRunner<64> runner1(config);
+    BusyPollRunner<64> runner2(config);
+    runner1.start();
+    runner2.start();
+
+    ContextRoute<RunnerContext, 64> route(context, runner1);
+    EXPECT_EQ(&route.runner(), &runner1);
+
+    constexpr uint32_t count = 20000;
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < 4; ++p) {
+        producers.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < count; ++i) {
+                route.send(EvValue {p, i});
+            }
+        });
+    }
+
+    {
+        SCOPED_TRACE("// case 1. context is moved back and forth while producers send");
+
+        size_t migrations = 0;
+        for (int i = 0; i < 20; ++i) {
+            while (route.migrating()) {
+                std::this_thread::yield();
+            }
+            auto &to = &route.runner() == &runner1 ? runner2 : runner1;
+            EXPECT_EQ(route.migrate(to), true);
+            EXPECT_EQ(&route.runner(), &to);
+            EXPECT_EQ(route.migrate(to), false);
+            ++migrations;
+        }
+        EXPECT_EQ(migrations, 20u);
+    }
+
+    for (auto &t : producers) {
+        t.join();
+    }
+    while (route.migrating() || route.processed() < 4 * count) {
+        std::this_thread::yield();
+    }
+
+    {
+        SCOPED_TRACE("// case 2. order of events sent by each producer is preserved");
+
+        std::atomic<bool> done {false};
+        route.runner().execute([&]() { done = true; });
+        while (!done) {
+            std::this_thread::yield();
+        }
+
+        runner1.stop();
+        runner2.stop();
+        EXPECT_EQ(route.processed(), 4 * count);
+        EXPECT_GE(runner1.processed() + runner2.processed(), 4 * count);
+        EXPECT_EQ(runner1.backlog() + runner2.backlog(), 0u);
+        for (const auto &values : context.received) {
+            ASSERT_EQ(values.size(), count);
+            for (uint32_t i = 0; i < count; ++i) {
+                ASSERT_EQ(values[i], i);
+            }
+        }
+    }
+}
+
+TEST_F(BusyPollRunnerTests, migrate_full)
+{
+    RunnerContext context;
+    context.transit<RunnerState>();
+
+    BusyPollRunner<4> runner1;
+    BusyPollRunner<4> runner2;
+    runner1.start();
+    runner2.start();
+
+    ContextRoute<RunnerContext, 4> route(context, runner1);
+    route.send(EvValue {0, 0});
+    while (route.processed() < 1) {
+        std::this_thread::yield();
+    }
+
+    // runner2 is busy and its ingress is full
+    std::atomic<bool> blocked {true};
+    std::atomic<std::thread::id> owner2 {};
+    runner2.execute([&]() {
+        owner2 = std::this_thread::get_id();
+        while (blocked) {
+            std::this_thread::yield();
+        }
+    });
+    while (owner2.load() == std::thread::id()) {
+        std::this_thread::yield();
+    }
+    while (runner2.try_execute([]() {})) {
+    }
+
+    {
+        SCOPED_TRACE("// case 1. old runner keeps running while ingress of new runner is full");
+
+        ASSERT_EQ(route.migrate(runner2), true);
+        std::atomic<bool> done {false};
+        runner1.execute([&]() { done = true; });
+        while (!done) {
+            std::this_thread::yield();
+        }
+        EXPECT_EQ(route.migrating(), true);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. handover completes once new runner is free");
+
+        blocked = false;
+        route.send(EvValue {0, 1});
+        while (route.migrating() || route.processed() < 2) {
+            std::this_thread::yield();
+        }
+
+        runner1.stop();
+        runner2.stop();
+        ASSERT_EQ(context.received[0].size(), 2u);
+        EXPECT_EQ(context.received[0][1], 1u);
+        EXPECT_EQ(context.reactor, owner2.load());
+    }
+}
+
+TEST_F(BusyPollRunnerTests, migrate_stop)
+{
+    const auto unlocked = [](RunnerContext &context) {
+        if (!context.mutex().try_lock()) {
+            return false;
+        }
+        context.mutex().unlock();
+        return true;
+    };
+
+    for (const bool newFirst : {false, true}) {
+        SCOPED_TRACE(newFirst ? "// case 1. runners are stopped right after migration, new runner first"
+                              : "// case 1. runners are stopped right after migration, old runner first");
+
+        RunnerContext context;
+        context.transit<RunnerState>();
+
+        BusyPollRunner<64> runner1;
+        BusyPollRunner<64> runner2;
+        runner1.start();
+        runner2.start();
+
+        ContextRoute<RunnerContext, 64> route(context, runner1);
+        route.send(EvValue {0, 0});
+        while (route.migrating() || route.processed() < 1) {
+            std::this_thread::yield();
+        }
+
+        ASSERT_EQ(route.migrate(runner2), true);
+        if (newFirst) {
+            runner2.stop();
+            runner1.stop();
+        } else {
+            runner1.stop();
+            runner2.stop();
+        }
+
+        // handover is either done or rolled back, context is not left locked
+        EXPECT_EQ(route.migrating(), false);
+        EXPECT_EQ(unlocked(context), true);
+        if (!newFirst) {
+            EXPECT_EQ(&route.runner(), &runner2);
+        }
+    }
+
+    {
+        SCOPED_TRACE("// case 2. migration to stopped runner is rolled back");
+
+        RunnerContext context;
+        context.transit<RunnerState>();
+
+        BusyPollRunner<64> runner1;
+        BusyPollRunner<64> runner2;
+        runner1.start();
+
+        ContextRoute<RunnerContext, 64> route(context, runner1);
+        std::atomic<std::thread::id> owner1 {};
+        runner1.execute([&]() { owner1 = std::this_thread::get_id(); });
+
+        runner2.start();
+        runner2.stop();
+        ASSERT_EQ(route.migrate(runner2), true);
+        while (route.migrating()) {
+            std::this_thread::yield();
+        }
+        EXPECT_EQ(&route.runner(), &runner1);
+
+        route.send(EvValue {0, 1});
+        while (route.processed() < 1) {
+            std::this_thread::yield();
+        }
+        runner1.stop();
+        ASSERT_EQ(context.received[0].size(), 1u);
+        EXPECT_EQ(context.received[0][0], 1u);
+        EXPECT_EQ(context.reactor, owner1.load());
+        EXPECT_EQ(unlocked(context), true);
+    }
+}
+
+TEST_F(BusyPollRunnerTests, migrate_pending)
+{
+    struct EvOpen {
+    };
+
+    struct IGateState {
+        virtual ~IGateState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvValue &) = 0;
+        virtual ProcessResult react(const EvOpen &) = 0;
+    };
+
+    struct GateContext : BaseContext<IGateState> {
+        using BaseContext<IGateState>::queueSize;
+
+        std::vector<uint32_t> received;
+        std::vector<std::thread::id> reactors;
+    };
+
+    struct Open : BaseState<IGateState> {
+        Open()
+            : BaseState<IGateState>("Open")
+        {
+        }
+
+        ProcessResult react(const EvValue &ev) override
+        {
+            auto *ctx = context<GateContext>();
+            ctx->received.emplace_back(ev.value);
+            ctx->reactors.emplace_back(std::this_thread::get_id());
+            return discard_event();
+        }
+
+        ProcessResult react(const EvOpen &) override
+        {
+            return discard_event();
+        }
+    };
+
+    struct Closed : BaseState<IGateState> {
+        Closed()
+            : BaseState<IGateState>("Closed")
+        {
+        }
+
+        ProcessResult react(const EvValue &) override
+        {
+            return defer_event();
+        }
+
+        ProcessResult react(const EvOpen &) override
+        {
+            return transit<Open>();
+        }
+    };
+
+    GateContext context;
+    context.transit<Closed>();
+
+    BusyPollRunner<64> runner1;
+    BusyPollRunner<64> runner2;
+    runner1.start();
+    runner2.start();
+
+    ContextRoute<GateContext, 64> route(context, runner1);
+    for (uint32_t i = 0; i < 10; ++i) {
+        route.send(EvValue {0, i});
+    }
+    while (route.processed() < 10) {
+        std::this_thread::yield();
+    }
+    std::atomic<std::thread::id> owner1 {};
+    runner1.execute([&]() { owner1 = std::this_thread::get_id(); });
+    while (owner1.load() == std::thread::id()) {
+        std::this_thread::yield();
+    }
+
+    {
+        SCOPED_TRACE("// case 1. deferred events move with context");
+
+        ASSERT_EQ(route.migrate(runner2), true);
+        route.send(EvOpen {});
+        route.send(EvValue {0, 10});
+        while (route.migrating() || route.processed() < 12) {
+            std::this_thread::yield();
+        }
+
+        std::atomic<bool> done {false};
+        runner2.execute([&]() { done = true; });
+        while (!done) {
+            std::this_thread::yield();
+        }
+
+        runner1.stop();
+        runner2.stop();
+        EXPECT_EQ(context.queueSize(), 0u);
+        ASSERT_EQ(context.received.size(), 11u);
+        for (uint32_t i = 0; i < 11; ++i) {
+            EXPECT_EQ(context.received[i], i);
+            EXPECT_NE(context.reactors[i], owner1.load());
+        }
+    }
+}
+
+#endif
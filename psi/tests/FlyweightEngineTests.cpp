@@ -0,0 +1,129 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "psi/sm/FlyweightEngine.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class FlyweightEngineTests : public Test
+{
+public:
+    struct EvOpen {
+    };
+
+    struct EvData {
+        uint16_t bytes;
+    };
+
+    struct EvClose {
+    };
+
+    struct Closed;
+    struct Opened;
+
+    /// @brief columns: 0 - number of received bytes, 1 - number of sessions
+    using Engine = FlyweightEngine<StateList<Closed, Opened>, uint32_t, uint16_t>;
+
+    struct Closed {
+        static ProcessResult react(Engine::Machine &m, const EvOpen &)
+        {
+            ++m.get<1>();
+            return m.transit<Opened>();
+        }
+
+        static ProcessResult react(Engine::Machine &, const EvData &)
+        {
+            return ProcessResult::DeferredEvent;
+        }
+    };
+
+    struct Opened {
+        static ProcessResult react(Engine::Machine &m, const EvData &ev)
+        {
+            m.get<0>() += ev.bytes;
+            return ProcessResult::DiscardedEvent;
+        }
+
+        static ProcessResult react(Engine::Machine &m, const EvClose &)
+        {
+            return m.transit<Closed>();
+        }
+    };
+};
+
+TEST_F(FlyweightEngineTests, create)
+{
+    static_assert(Engine::BytesPerMachine == 7);
+    static_assert(Engine::stateIndex<Closed>() == 0);
+    static_assert(Engine::stateIndex<Opened>() == 1);
+
+    Engine engine;
+    engine.reserve(3);
+    EXPECT_EQ(engine.create(0, 0), 0u);
+    EXPECT_EQ(engine.create<Opened>(10, 1), 1u);
+    EXPECT_EQ(engine.size(), 2u);
+
+    EXPECT_EQ(engine.state(0), Engine::stateIndex<Closed>());
+    EXPECT_EQ(engine.state(1), Engine::stateIndex<Opened>());
+    EXPECT_EQ(engine.column<0>(1), 10u);
+    EXPECT_EQ(engine.column<1>(1), 1u);
+    EXPECT_EQ(engine.count<Opened>(), 1u);
+}
+
+TEST_F(FlyweightEngineTests, process_event)
+{
+    Engine engine;
+    const auto id = engine.create(0, 0);
+
+    {
+        SCOPED_TRACE("// case 1. reaction is not declared by state");
+
+        EXPECT_EQ(engine.process_event(id, EvClose {}), ProcessResult::UnconsumedEvent);
+        EXPECT_EQ(engine.state(id), Engine::stateIndex<Closed>());
+    }
+
+    {
+        SCOPED_TRACE("// case 2. reaction result is returned to caller");
+
+        EXPECT_EQ(engine.process_event(id, EvData {5}), ProcessResult::DeferredEvent);
+        EXPECT_EQ(engine.column<0>(id), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. transitions");
+
+        EXPECT_EQ(engine.process_event(id, EvOpen {}), ProcessResult::TransitState);
+        EXPECT_EQ(engine.state(id), Engine::stateIndex<Opened>());
+        EXPECT_EQ(engine.process_event(id, EvData {5}), ProcessResult::DiscardedEvent);
+        EXPECT_EQ(engine.process_event(id, EvData {7}), ProcessResult::DiscardedEvent);
+        EXPECT_EQ(engine.process_event(id, EvClose {}), ProcessResult::TransitState);
+        EXPECT_EQ(engine.state(id), Engine::stateIndex<Closed>());
+        EXPECT_EQ(engine.column<0>(id), 12u);
+        EXPECT_EQ(engine.column<1>(id), 1u);
+    }
+}
+
+TEST_F(FlyweightEngineTests, process_event_all)
+{
+    Engine engine;
+    const size_t machines = 10000;
+    engine.reserve(machines);
+    for (size_t i = 0; i < machines; ++i) {
+        engine.create(0, 0);
+    }
+
+    for (Engine::MachineId id = 0; id < machines; id += 2) {
+        engine.process_event(id, EvOpen {});
+    }
+    EXPECT_EQ(engine.count<Opened>(), machines / 2);
+
+    EXPECT_EQ(engine.process_event_all(EvData {3}), machines);
+    EXPECT_EQ(engine.process_event_all(EvClose {}), machines / 2);
+    EXPECT_EQ(engine.count<Closed>(), machines);
+
+    for (Engine::MachineId id = 0; id < machines; ++id) {
+        ASSERT_EQ(engine.column<0>(id), id % 2 ? 0u : 3u);
+    }
+}
@@ -0,0 +1,124 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "SampleMachine.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+using namespace psi::sm::generated;
+
+class GeneratedMachineTests : public Test
+{
+public:
+    struct Actions {
+        using Machine = SampleMachine<Actions>;
+
+        void onStart(Machine &, const EvStart &)
+        {
+            log.emplace_back("start");
+        }
+
+        bool accepts(const Machine &, const EvData &ev) const
+        {
+            return ev.value >= 0;
+        }
+
+        void consume(Machine &, const EvData &ev)
+        {
+            log.emplace_back("data " + std::to_string(ev.value));
+        }
+
+        void pong(Machine &machine, const EvPing &)
+        {
+            log.emplace_back("pong");
+            machine.process_event(EvStop {});
+            log.emplace_back("pong end");
+        }
+
+        void onRunning(Machine &)
+        {
+            log.emplace_back("enter Running");
+        }
+
+        void onLeftRunning(Machine &)
+        {
+            log.emplace_back("exit Running");
+        }
+
+        std::vector<std::string> log;
+    };
+
+    Actions actions;
+    SampleMachine<Actions> machine {actions};
+};
+
+TEST_F(GeneratedMachineTests, reactions)
+{
+    EXPECT_EQ(machine.state(), SampleState::Idle);
+    EXPECT_STREQ(to_string(machine.state()), "Idle");
+
+    {
+        SCOPED_TRACE("// case 1. unconsumed and wildcard events do not change state");
+
+        machine.process_event(EvStop {});
+        machine.process_event(EvPing {});
+        EXPECT_EQ(machine.state(), SampleState::Idle);
+        EXPECT_TRUE(actions.log.empty());
+    }
+
+    {
+        SCOPED_TRACE("// case 2. deferred events are re-processed in order after transition, guard selects rule");
+
+        machine.process_event(EvData {1});
+        machine.process_event(EvData {-1});
+        machine.process_event(EvData {2});
+        EXPECT_EQ(machine.queueSize(), 3u);
+
+        machine.process_event(EvStart {});
+        EXPECT_EQ(machine.state(), SampleState::Running);
+        EXPECT_EQ(machine.queueSize(), 0u);
+        EXPECT_THAT(actions.log, ElementsAre("start", "enter Running", "data 1", "data 2"));
+        actions.log.clear();
+    }
+
+    {
+        SCOPED_TRACE("// case 3. event passed by action is processed after reaction");
+
+        machine.process_event(EvPing {});
+        EXPECT_EQ(machine.state(), SampleState::Stopped);
+        EXPECT_THAT(actions.log, ElementsAre("pong", "pong end", "exit Running"));
+        actions.log.clear();
+    }
+
+    {
+        SCOPED_TRACE("// case 4. posting transition re-processes event by new state");
+
+        machine.process_event(EvReset {});
+        EXPECT_EQ(machine.state(), SampleState::Idle);
+        EXPECT_EQ(machine.queueSize(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 5. posted events are processed before deferred ones");
+
+        machine.process_event(EvData {3});
+        machine.post_event(EvData {4});
+        machine.post_event(EvStart {});
+        EXPECT_EQ(machine.queueSize(), 3u);
+
+        machine.process_event(EvPing {});
+        EXPECT_EQ(machine.state(), SampleState::Idle);
+
+        machine.process_event(EvData {5});
+        EXPECT_EQ(machine.queueSize(), 4u);
+
+        machine.process_event(EvStart {});
+        EXPECT_EQ(machine.state(), SampleState::Running);
+        EXPECT_EQ(machine.queueSize(), 0u);
+        EXPECT_THAT(actions.log, ElementsAre("start", "enter Running", "data 4", "data 3", "data 5"));
+    }
+}
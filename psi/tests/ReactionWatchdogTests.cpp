@@ -0,0 +1,157 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#ifndef PSI_SM_WATCHDOG
+#error "PSI_SM_WATCHDOG must be defined, test is built by tests/hooks"
+#endif
+
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+namespace {
+
+struct EvFast {
+};
+
+struct EvSlow {
+    std::chrono::milliseconds duration;
+};
+
+struct IWatchedState {
+    virtual ~IWatchedState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvFast &) = 0;
+    virtual ProcessResult react(const EvSlow &) = 0;
+};
+
+struct WatchedState : BaseState<IWatchedState> {
+    WatchedState()
+        : BaseState<IWatchedState>("WatchedState")
+    {
+    }
+
+    ProcessResult react(const EvFast &) override
+    {
+        return discard_event();
+    }
+
+    ProcessResult react(const EvSlow &ev) override
+    {
+        std::this_thread::sleep_for(ev.duration);
+        return discard_event();
+    }
+};
+
+struct WatchedContext : BaseContext<IWatchedState> {
+};
+
+const watchdog::LatencyStats *find(const std::vector<watchdog::LatencyStats> &stats, const std::string &event)
+{
+    for (const auto &s : stats) {
+        if (s.state == "(anonymous namespace)::WatchedState" && s.event == event) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+class ReactionWatchdogTests : public Test
+{
+public:
+    void TearDown() override
+    {
+        watchdog::Watchdog::instance().stop();
+    }
+};
+
+TEST_F(ReactionWatchdogTests, slow_reaction)
+{
+    auto &wd = watchdog::Watchdog::instance();
+
+    std::mutex mutex;
+    std::vector<watchdog::SlowReaction> reported;
+    wd.start(std::chrono::milliseconds(20), std::chrono::milliseconds(2), [&](const watchdog::SlowReaction &slow) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reported.push_back(slow);
+    });
+
+    WatchedContext context;
+    context.transit<WatchedState>();
+
+    {
+        SCOPED_TRACE("// case 1. reactions within budget are not reported");
+
+        for (int i = 0; i < 100; ++i) {
+            context.process_event(EvFast {});
+        }
+        context.process_event(EvSlow {std::chrono::milliseconds(1)});
+
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(reported.size(), 0u);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. reaction running over budget is reported once while it runs");
+
+        context.process_event(EvSlow {std::chrono::milliseconds(100)});
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(reported.size(), 1u);
+        EXPECT_EQ(reported[0].context, &context);
+        EXPECT_EQ(reported[0].state, "(anonymous namespace)::WatchedState");
+        EXPECT_EQ(reported[0].event, "(anonymous namespace)::EvSlow");
+        EXPECT_GE(reported[0].elapsed, std::chrono::milliseconds(20));
+        EXPECT_LT(reported[0].elapsed, std::chrono::milliseconds(100));
+    }
+
+    wd.stop();
+    EXPECT_GE(wd.slowReactions(), 1u);
+}
+
+TEST_F(ReactionWatchdogTests, latencies)
+{
+    auto &wd = watchdog::Watchdog::instance();
+    const auto before = wd.latencies();
+    const auto *fastBefore = find(before, "(anonymous namespace)::EvFast");
+    const uint64_t fastCount = fastBefore ? fastBefore->count : 0;
+
+    WatchedContext context;
+    context.transit<WatchedState>();
+    for (int i = 0; i < 1000; ++i) {
+        context.process_event(EvFast {});
+    }
+    // reactions of other threads are merged, data of exited thread is retired
+    const size_t threads = wd.threadCount();
+    std::thread([&context]() { context.process_event(EvSlow {std::chrono::milliseconds(5)}); }).join();
+    EXPECT_EQ(wd.threadCount(), threads);
+
+    const auto after = wd.latencies();
+    const auto *fast = find(after, "(anonymous namespace)::EvFast");
+    ASSERT_NE(fast, nullptr);
+    EXPECT_EQ(fast->count, fastCount + 1000);
+    EXPECT_LE(fast->p50, fast->p99);
+    EXPECT_LE(fast->p99, fast->max);
+
+    const auto *slow = find(after, "(anonymous namespace)::EvSlow");
+    ASSERT_NE(slow, nullptr);
+    EXPECT_GE(slow->max, std::chrono::milliseconds(4));
+    EXPECT_GT(slow->max, fast->p99);
+
+    std::ostringstream os;
+    wd.report(os);
+    EXPECT_NE(os.str().find("(anonymous namespace)::EvFast"), std::string::npos);
+}
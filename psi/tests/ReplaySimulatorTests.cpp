@@ -0,0 +1,231 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+#include "psi/sm/EventLog.h"
+#include "psi/sm/ReplaySimulator.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class ReplaySimulatorTests : public Test
+{
+public:
+    struct Record {
+        uint64_t key;
+        uint32_t seq;
+        uint32_t close;
+    };
+
+    struct EvRecord {
+        uint32_t seq;
+    };
+
+    struct EvClose {
+    };
+
+    struct ITestState {
+        virtual ~ITestState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvRecord &) = 0;
+        virtual ProcessResult react(const EvClose &) = 0;
+    };
+
+    struct TestContext : BaseContext<ITestState> {
+        TestContext(uint64_t k, std::pmr::memory_resource *resource);
+
+        uint64_t key;
+        std::vector<uint32_t> received;
+        uint32_t violations = 0;
+    };
+
+    struct Open : BaseState<ITestState> {
+        Open()
+            : BaseState<ITestState>("Open")
+        {
+        }
+
+        ProcessResult react(const EvRecord &ev) override
+        {
+            auto *ctx = context<TestContext>();
+            if (!ctx->received.empty() && ctx->received.back() + 1 != ev.seq) {
+                ++ctx->violations;
+            }
+            ctx->received.emplace_back(ev.seq);
+            return discard_event();
+        }
+
+        ProcessResult react(const EvClose &) override;
+    };
+
+    struct Closed : BaseState<ITestState> {
+        Closed()
+            : BaseState<ITestState>("Closed")
+        {
+        }
+
+        ProcessResult react(const EvRecord &) override
+        {
+            return discard_event();
+        }
+
+        ProcessResult react(const EvClose &) override
+        {
+            return discard_event();
+        }
+    };
+
+    using Simulator = ReplaySimulator<TestContext>;
+
+    static std::unique_ptr<TestContext> create(uint64_t key, std::pmr::memory_resource *resource)
+    {
+        return std::make_unique<TestContext>(key, resource);
+    }
+
+    static uint64_t keyOf(const Record &record)
+    {
+        return record.key;
+    }
+
+    static void feed(TestContext &context, const Record &record)
+    {
+        if (record.close) {
+            context.process_event(EvClose {});
+        } else {
+            context.process_event(EvRecord {record.seq});
+        }
+    }
+
+    /// @brief records of keys interleaved, sequence numbers of each key start from 1
+    static std::vector<Record> makeRecords(size_t keys, size_t perKey)
+    {
+        std::vector<Record> records;
+        for (uint32_t seq = 1; seq <= perKey; ++seq) {
+            for (uint64_t key = 0; key < keys; ++key) {
+                records.emplace_back(Record {key * 7919, seq, 0});
+            }
+        }
+        return records;
+    }
+};
+
+ReplaySimulatorTests::TestContext::TestContext(uint64_t k, std::pmr::memory_resource *resource)
+    : BaseContext<ITestState>(resource)
+    , key(k)
+{
+    transit<Open>();
+}
+
+ProcessResult ReplaySimulatorTests::Open::react(const EvClose &)
+{
+    return transit<Closed>();
+}
+
+TEST_F(ReplaySimulatorTests, run)
+{
+    const size_t keys = 100;
+    const size_t perKey = 50;
+    auto records = makeRecords(keys, perKey);
+
+    Simulator simulator(&create, 4);
+    EXPECT_EQ(simulator.shards(), 4u);
+
+    {
+        SCOPED_TRACE("// case 1. records of each key are processed in order by its own context");
+
+        const auto stats = simulator.run(records.data(), records.size(), &keyOf, &feed);
+        EXPECT_EQ(stats.events, records.size());
+        EXPECT_EQ(stats.contexts, keys);
+        ASSERT_EQ(stats.shardEvents.size(), 4u);
+
+        size_t contexts = 0;
+        simulator.forEach([&](uint64_t key, TestContext &context) {
+            ++contexts;
+            EXPECT_EQ(context.key, key);
+            EXPECT_EQ(context.violations, 0u);
+            EXPECT_EQ(context.received.size(), perKey);
+            EXPECT_EQ(context.currentState().value()->name(), "Open");
+            EXPECT_EQ(context.memoryResource() == std::pmr::get_default_resource(), false);
+        });
+        EXPECT_EQ(contexts, keys);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. contexts keep their states between runs");
+
+        std::vector<Record> closing;
+        for (uint64_t key = 0; key < keys; key += 2) {
+            closing.emplace_back(Record {key * 7919, 0, 1});
+        }
+        const auto stats = simulator.run(closing.data(), closing.size(), &keyOf, &feed);
+        EXPECT_EQ(stats.events, closing.size());
+        EXPECT_EQ(stats.contexts, keys);
+
+        std::map<std::string, size_t> states;
+        simulator.forEach([&](uint64_t, TestContext &context) { ++states[context.currentState().value()->name()]; });
+        EXPECT_EQ(states["Open"], keys / 2);
+        EXPECT_EQ(states["Closed"], keys / 2);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. empty input");
+
+        const auto stats = simulator.run(records.data(), 0, &keyOf, &feed);
+        EXPECT_EQ(stats.events, 0u);
+        EXPECT_EQ(stats.contexts, keys);
+    }
+}
+
+#ifdef __linux__
+
+TEST_F(ReplaySimulatorTests, event_log)
+{
+    const std::string path = "/tmp/psi-sm-tests-" + std::to_string(::getpid()) + ".log";
+    auto records = makeRecords(10, 20);
+
+    {
+        SCOPED_TRACE("// case 1. written records are read in place");
+
+        {
+            auto writer = EventLogWriter<Record>::create(path);
+            ASSERT_TRUE(writer);
+            for (const auto &record : records) {
+                EXPECT_TRUE(writer->append(record));
+            }
+            EXPECT_EQ(writer->size(), records.size());
+        }
+
+        auto reader = EventLogReader<Record>::open(path);
+        ASSERT_TRUE(reader);
+        ASSERT_EQ(reader->size(), records.size());
+        for (size_t i = 0; i < records.size(); ++i) {
+            EXPECT_EQ((*reader)[i].key, records[i].key);
+            EXPECT_EQ((*reader)[i].seq, records[i].seq);
+        }
+
+        Simulator simulator(&create, 3);
+        const auto stats = simulator.run(reader->data(), reader->size(), &keyOf, &feed);
+        EXPECT_EQ(stats.events, records.size());
+        EXPECT_EQ(stats.contexts, 10u);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. file of other record type or missing file is rejected");
+
+        EXPECT_FALSE(EventLogReader<EvRecord>::open(path));
+        EXPECT_FALSE(EventLogReader<Record>::open(path + ".missing"));
+    }
+
+    std::remove(path.c_str());
+}
+
+#endif
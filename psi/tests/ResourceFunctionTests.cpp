@@ -0,0 +1,83 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <memory_resource>
+
+#include "psi/sm/ResourceFunction.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class ResourceFunctionTests : public Test
+{
+public:
+    using Fn = ResourceFunction<int(int)>;
+};
+
+TEST_F(ResourceFunctionTests, inline_target)
+{
+    std::array<std::byte, 256> buffer;
+    std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+    int base = 10;
+    Fn fn([&base](int x) { return base + x; }, &resource);
+
+    EXPECT_EQ(bool(fn), true);
+    EXPECT_EQ(fn.resource(), nullptr);
+    EXPECT_EQ(fn(5), 15);
+}
+
+TEST_F(ResourceFunctionTests, allocated_target)
+{
+    std::array<std::byte, 256> buffer;
+    std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+    std::array<int, 8> values {1, 2, 3, 4, 5, 6, 7, 8};
+    Fn fn([values](int i) { return values[i]; }, &resource);
+
+    EXPECT_EQ(fn.resource(), &resource);
+    EXPECT_EQ(fn(7), 8);
+
+    Fn moved(std::move(fn));
+    EXPECT_EQ(bool(fn), false);
+    EXPECT_EQ(moved.resource(), &resource);
+    EXPECT_EQ(moved(0), 1);
+}
+
+TEST_F(ResourceFunctionTests, target_destroyed)
+{
+    auto counter = std::make_shared<int>(0);
+
+    {
+        Fn fn([counter](int x) { return *counter + x; });
+        EXPECT_EQ(counter.use_count(), 2);
+
+        Fn other;
+        other = std::move(fn);
+        EXPECT_EQ(counter.use_count(), 2);
+        EXPECT_EQ(other(1), 1);
+    }
+
+    EXPECT_EQ(counter.use_count(), 1);
+}
+
+TEST_F(ResourceFunctionTests, target)
+{
+    struct Add {
+        int value;
+
+        int operator()(int x) const
+        {
+            return value + x;
+        }
+    };
+
+    Fn fn(Add {3});
+    ASSERT_NE(fn.target<Add>(), nullptr);
+    EXPECT_EQ(fn.target<Add>()->value, 3);
+    EXPECT_EQ(fn.target<int>(), nullptr);
+    EXPECT_EQ(Fn().target<Add>(), nullptr);
+}
@@ -0,0 +1,209 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#ifdef __linux__
+
+#include <sys/wait.h>
+#include <thread>
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+#include "psi/sm/ShmEventRing.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+class ShmEventRingTests : public Test
+{
+public:
+    struct EvValue {
+        uint32_t producer;
+        uint32_t value;
+    };
+
+    struct ITestState {
+        virtual ~ITestState() = default;
+
+        virtual const std::string &name() const = 0;
+
+        virtual ProcessResult react(const EvValue &) = 0;
+    };
+
+    struct TestContext : BaseContext<ITestState> {
+        std::vector<EvValue> received;
+    };
+
+    struct TestState : BaseState<ITestState> {
+        TestState()
+            : BaseState<ITestState>("TestState")
+        {
+        }
+
+        ProcessResult react(const EvValue &ev) override
+        {
+            context<TestContext>()->received.emplace_back(ev);
+            return discard_event();
+        }
+    };
+
+    using Ring = ShmEventRing<EvValue, 64>;
+
+    void SetUp() override
+    {
+        m_name = "/psi-sm-tests-" + std::to_string(::getpid());
+        Ring::unlink(m_name);
+    }
+
+    void TearDown() override
+    {
+        Ring::unlink(m_name);
+    }
+
+    /// @brief starts producer process which pushes 'count' events to ring
+    pid_t startProducer(uint32_t producer, uint32_t count)
+    {
+        const pid_t pid = ::fork();
+        if (pid == 0) {
+            auto ring = Ring::open(m_name);
+            if (!ring) {
+                ::_exit(1);
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                while (!ring->try_push(EvValue {producer, i})) {
+                    std::this_thread::yield();
+                }
+            }
+            ::_exit(0);
+        }
+        return pid;
+    }
+
+    /// @brief drains ring into context until 'count' events are received
+    void consume(Ring &ring, TestContext &context, size_t count)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (context.received.size() < count && std::chrono::steady_clock::now() < deadline) {
+            if (!ring.drain(context)) {
+                ring.wait(std::chrono::milliseconds(100));
+            }
+        }
+    }
+
+    static int exitCode(pid_t pid)
+    {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+protected:
+    std::string m_name;
+};
+
+TEST_F(ShmEventRingTests, open)
+{
+    {
+        SCOPED_TRACE("// case 1. ring does not exist");
+
+        EXPECT_EQ(Ring::open(m_name), nullptr);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. ring has another layout");
+
+        auto ring = Ring::create(m_name);
+        ASSERT_NE(ring, nullptr);
+        EXPECT_EQ((ShmEventRing<EvValue, 128>::open(m_name)), nullptr);
+        EXPECT_NE(Ring::open(m_name), nullptr);
+    }
+
+    {
+        SCOPED_TRACE("// case 3. existing ring is not reset by create");
+
+        auto ring = Ring::open(m_name);
+        ASSERT_NE(ring, nullptr);
+        EXPECT_EQ(ring->try_push(EvValue {0, 1}), true);
+        EXPECT_EQ(Ring::create(m_name), nullptr);
+
+        auto reopened = Ring::open(m_name);
+        ASSERT_NE(reopened, nullptr);
+        const auto ev = reopened->try_pop();
+        ASSERT_EQ(ev.has_value(), true);
+        EXPECT_EQ(ev->value, 1u);
+
+        Ring::unlink(m_name);
+        EXPECT_NE(Ring::create(m_name), nullptr);
+    }
+}
+
+TEST_F(ShmEventRingTests, push_pop)
+{
+    auto ring = Ring::create(m_name);
+    ASSERT_NE(ring, nullptr);
+    EXPECT_EQ(ring->empty(), true);
+    EXPECT_EQ(ring->try_pop().has_value(), false);
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        EXPECT_EQ(ring->try_push(EvValue {0, i}), true);
+    }
+    EXPECT_EQ(ring->try_push(EvValue {0, 64}), false);
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        const auto ev = ring->try_pop();
+        ASSERT_EQ(ev.has_value(), true);
+        EXPECT_EQ(ev->value, i);
+    }
+    EXPECT_EQ(ring->empty(), true);
+    EXPECT_EQ(ring->wait(std::chrono::milliseconds(1)), false);
+}
+
+TEST_F(ShmEventRingTests, spsc_process)
+{
+    auto ring = Ring::create(m_name);
+    ASSERT_NE(ring, nullptr);
+
+    TestContext context;
+    context.transit<TestState>();
+
+    const uint32_t count = 10000;
+    const pid_t producer = startProducer(0, count);
+    ASSERT_GT(producer, 0);
+
+    consume(*ring, context, count);
+    EXPECT_EQ(exitCode(producer), 0);
+
+    ASSERT_EQ(context.received.size(), count);
+    for (uint32_t i = 0; i < count; ++i) {
+        EXPECT_EQ(context.received[i].value, i);
+    }
+}
+
+TEST_F(ShmEventRingTests, mpsc_process)
+{
+    auto ring = Ring::create(m_name);
+    ASSERT_NE(ring, nullptr);
+
+    TestContext context;
+    context.transit<TestState>();
+
+    const uint32_t count = 10000;
+    const pid_t producer1 = startProducer(1, count);
+    const pid_t producer2 = startProducer(2, count);
+    ASSERT_GT(producer1, 0);
+    ASSERT_GT(producer2, 0);
+
+    consume(*ring, context, 2 * count);
+    EXPECT_EQ(exitCode(producer1), 0);
+    EXPECT_EQ(exitCode(producer2), 0);
+
+    ASSERT_EQ(context.received.size(), 2 * count);
+    uint32_t expected[3] = {0, 0, 0};
+    for (const auto &ev : context.received) {
+        ASSERT_EQ(ev.value, expected[ev.producer]++);
+    }
+    EXPECT_EQ(expected[1], count);
+    EXPECT_EQ(expected[2], count);
+}
+
+#endif
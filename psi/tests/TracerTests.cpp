@@ -0,0 +1,155 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#ifndef PSI_SM_TRACE
+#error "PSI_SM_TRACE must be defined, test is built by tests/hooks"
+#endif
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+namespace {
+
+struct EvTraced {
+};
+
+struct ITracedState {
+    virtual ~ITracedState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvTraced &) = 0;
+};
+
+struct TracedState2;
+
+struct TracedState1 : BaseState<ITracedState> {
+    TracedState1()
+        : BaseState<ITracedState>("TracedState1")
+    {
+    }
+
+    ProcessResult react(const EvTraced &) override;
+};
+
+struct TracedState2 : BaseState<ITracedState> {
+    TracedState2()
+        : BaseState<ITracedState>("TracedState2")
+    {
+    }
+
+    ProcessResult react(const EvTraced &) override
+    {
+        return defer_event();
+    }
+};
+
+ProcessResult TracedState1::react(const EvTraced &)
+{
+    return transit<TracedState2>();
+}
+
+struct TracedContext : BaseContext<ITracedState> {
+};
+
+} // namespace
+
+class TracerTests : public Test
+{
+public:
+    void SetUp() override
+    {
+        m_path = ::testing::TempDir() + "psi-sm-trace.json";
+    }
+
+    void TearDown() override
+    {
+        trace::Tracer::instance().stop();
+        std::remove(m_path.c_str());
+    }
+
+    std::string readTrace() const
+    {
+        std::ifstream in(m_path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    static size_t count(const std::string &text, const std::string &what)
+    {
+        size_t result = 0;
+        for (auto pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) {
+            ++result;
+        }
+        return result;
+    }
+
+protected:
+    std::string m_path;
+};
+
+TEST_F(TracerTests, record)
+{
+    auto &tracer = trace::Tracer::instance();
+
+    {
+        SCOPED_TRACE("// case 1. tracer is not started");
+
+        TracedContext context;
+        context.transit<TracedState1>();
+        context.process_event(EvTraced {});
+        EXPECT_EQ(tracer.enabled(), false);
+    }
+
+    {
+        SCOPED_TRACE("// case 2. all calls are sampled");
+
+        ASSERT_EQ(tracer.start(m_path), true);
+
+        TracedContext context;
+        context.transit<TracedState1>();
+        context.process_event(EvTraced {});
+        context.process_event(EvTraced {});
+
+        tracer.stop();
+
+        const auto trace = readTrace();
+        EXPECT_EQ(trace.rfind("{\"traceEvents\":[", 0), 0u);
+        EXPECT_NE(trace.find("]}"), std::string::npos);
+        EXPECT_EQ(count(trace, "\"cat\":\"event\""), 2u);
+        EXPECT_EQ(count(trace, "\"cat\":\"transit\""), 2u);
+        EXPECT_EQ(count(trace, "\"cat\":\"defer\""), 1u);
+        EXPECT_EQ(count(trace, "\"result\":\"TransitState\""), 1u);
+        EXPECT_EQ(count(trace, "\"result\":\"DeferredEvent\""), 1u);
+        EXPECT_NE(trace.find("\"name\":\"(anonymous namespace)::TracedState2\""), std::string::npos);
+        EXPECT_NE(trace.find("\"from\":\"(anonymous namespace)::TracedState1\""), std::string::npos);
+        EXPECT_EQ(tracer.dropped(), 0u);
+    }
+}
+
+TEST_F(TracerTests, sample)
+{
+    auto &tracer = trace::Tracer::instance();
+    ASSERT_EQ(tracer.start(m_path, 4), true);
+
+    TracedContext context;
+    context.transit<TracedState2>();
+    for (int i = 0; i < 16; ++i) {
+        context.process_event(EvTraced {});
+    }
+
+    tracer.stop();
+
+    const auto trace = readTrace();
+    EXPECT_EQ(count(trace, "\"cat\":\"event\""), 4u);
+    EXPECT_EQ(count(trace, "\"cat\":\"defer\""), 4u);
+}
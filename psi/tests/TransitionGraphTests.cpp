@@ -0,0 +1,160 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "psi/sm/BaseState.h"
+#include "psi/sm/TransitionGraph.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+namespace {
+
+struct EvToggle {
+};
+
+struct IGraphState {
+    virtual ~IGraphState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvToggle &) = 0;
+};
+
+} // namespace
+
+template <>
+struct psi::sm::TransitionObserver<IGraphState> : psi::sm::GraphObserver<IGraphState, 4> {
+};
+
+class TransitionGraphTests : public Test
+{
+public:
+    struct TestContext : GraphContext<IGraphState, 4> {
+    };
+
+    struct PingState;
+    struct PongState;
+
+    template <typename NextState>
+    struct ToggleState : BaseState<IGraphState> {
+        ToggleState(const std::string &name)
+            : BaseState<IGraphState>(name)
+        {
+        }
+
+        ProcessResult react(const EvToggle &) override
+        {
+            return this->template transit<NextState>();
+        }
+    };
+
+    struct PingState : ToggleState<PongState> {
+        PingState()
+            : ToggleState<PongState>("PingState")
+        {
+        }
+    };
+
+    struct PongState : ToggleState<PingState> {
+        PongState()
+            : ToggleState<PingState>("PongState")
+        {
+        }
+    };
+
+    struct OtherState : ToggleState<PingState> {
+        OtherState()
+            : ToggleState<PingState>("OtherState")
+        {
+        }
+    };
+};
+
+TEST_F(TransitionGraphTests, record)
+{
+    TestContext context;
+    EXPECT_EQ(context.currentStateId(), InvalidStateId);
+
+    context.transit<PingState>();
+    const auto ping = context.currentStateId();
+    EXPECT_EQ(ping, StateIds<IGraphState>::of<PingState>());
+
+    for (int i = 0; i < 5; ++i) {
+        context.process_event(EvToggle {});
+    }
+    const auto pong = StateIds<IGraphState>::of<PongState>();
+    EXPECT_EQ(context.currentStateId(), pong);
+
+    context.transit<OtherState>();
+    const auto other = StateIds<IGraphState>::of<OtherState>();
+
+    const auto graph = context.transitionGraph();
+    EXPECT_EQ(graph.name(ping), "PingState");
+    EXPECT_EQ(graph.name(pong), "PongState");
+    EXPECT_EQ(graph.name(other), "OtherState");
+    EXPECT_EQ(graph.edge(ping, pong).hits, 3u);
+    EXPECT_EQ(graph.edge(pong, ping).hits, 2u);
+    EXPECT_EQ(graph.edge(pong, other).hits, 1u);
+    EXPECT_EQ(graph.edge(ping, other).hits, 0u);
+    EXPECT_EQ(graph.overflow(), 0u);
+
+    const auto dot = context.dumpDot();
+    EXPECT_EQ(dot.rfind("digraph transitions {", 0), 0u);
+    EXPECT_NE(dot.find("[label=\"PingState\"]"), std::string::npos);
+    EXPECT_NE(dot.find("s" + std::to_string(ping) + " -> s" + std::to_string(pong) + " [label=\"3 / "),
+              std::string::npos);
+
+    const auto json = context.dumpJson();
+    EXPECT_NE(json.find("{\"id\":" + std::to_string(pong) + ",\"name\":\"PongState\"}"), std::string::npos);
+    EXPECT_NE(json.find("{\"from\":" + std::to_string(pong) + ",\"to\":" + std::to_string(ping) + ",\"hits\":2,"),
+              std::string::npos);
+}
+
+TEST_F(TransitionGraphTests, overflow)
+{
+    TransitionGraph<2> graph;
+    graph.record(InvalidStateId, 0, "S0", 100);
+    graph.record(0, 1, "S1", 300);
+    graph.record(1, 2, "S2", 400);
+
+    EXPECT_EQ(graph.edge(0, 1).hits, 1u);
+    EXPECT_EQ(graph.edge(0, 1).time, 200u);
+    EXPECT_EQ(graph.overflow(), 1u);
+
+    // overflowed identifiers may be queried
+    EXPECT_EQ(graph.edge(1, 2).hits, 0u);
+    EXPECT_EQ(graph.edge(2, 1).hits, 0u);
+    EXPECT_EQ(graph.name(2), "");
+
+    graph.reset();
+    EXPECT_EQ(graph.edge(0, 1).hits, 0u);
+    EXPECT_EQ(graph.name(1), "S1");
+}
+
+TEST_F(TransitionGraphTests, escape)
+{
+    TransitionGraph<2> graph;
+
+    {
+        SCOPED_TRACE("// case 1. no edges before first transition between states");
+
+        graph.record(InvalidStateId, 0, "Quoted \"S0\"", 100);
+        EXPECT_EQ(graph.edge(0, 1).hits, 0u);
+        EXPECT_EQ(graph.toJson(), "{\"states\":[{\"id\":0,\"name\":\"Quoted \\\"S0\\\"\"}],\"edges\":[]}");
+    }
+
+    {
+        SCOPED_TRACE("// case 2. quotes and backslashes of names are escaped");
+
+        graph.record(0, 1, "Path\\S1", 300);
+        EXPECT_EQ(graph.edge(0, 1).hits, 1u);
+
+        const auto dot = graph.toDot();
+        EXPECT_NE(dot.find("s0 [label=\"Quoted \\\"S0\\\"\"];"), std::string::npos);
+        EXPECT_NE(dot.find("s1 [label=\"Path\\\\S1\"];"), std::string::npos);
+
+        const auto json = graph.toJson();
+        EXPECT_NE(json.find("{\"id\":1,\"name\":\"Path\\\\S1\"}"), std::string::npos);
+    }
+}
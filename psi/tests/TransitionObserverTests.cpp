@@ -0,0 +1,88 @@
+#include "TestHelper.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+
+using namespace ::testing;
+using namespace psi::sm;
+
+namespace {
+
+struct IObservedState {
+    virtual ~IObservedState() = default;
+
+    virtual const std::string &name() const = 0;
+};
+
+struct Transition {
+    std::string from;
+    std::string to;
+    const void *context;
+
+    friend bool operator==(const Transition &a, const Transition &b)
+    {
+        return a.from == b.from && a.to == b.to && a.context == b.context;
+    }
+};
+
+std::vector<Transition> g_transitions;
+
+} // namespace
+
+template <>
+struct psi::sm::TransitionObserver<IObservedState> {
+    template <typename NewState>
+    static void on_transition(BaseContext<IObservedState> &context,
+                              const IObservedState *oldState,
+                              const NewState &newState)
+    {
+        g_transitions.push_back({oldState ? oldState->name() : "", newState.name(), &context});
+    }
+};
+
+class TransitionObserverTests : public Test
+{
+public:
+    struct TestContext : BaseContext<IObservedState> {
+    };
+
+    struct TestState1 : BaseState<IObservedState> {
+        TestState1()
+            : BaseState<IObservedState>("TestState1")
+        {
+        }
+    };
+
+    struct TestState2 : BaseState<IObservedState> {
+        TestState2()
+            : BaseState<IObservedState>("TestState2")
+        {
+        }
+    };
+};
+
+TEST_F(TransitionObserverTests, on_transition)
+{
+    g_transitions.clear();
+    TestContext context;
+
+    {
+        SCOPED_TRACE("// case 1. initial state");
+
+        context.transit<TestState1>();
+        EXPECT_EQ(g_transitions, std::vector<Transition>({{"", "TestState1", &context}}));
+    }
+
+    {
+        SCOPED_TRACE("// case 2. transit old -> new state");
+
+        context.transit<TestState2>();
+        context.transit<TestState1>();
+        EXPECT_EQ(g_transitions,
+                  std::vector<Transition>({{"", "TestState1", &context},
+                                           {"TestState1", "TestState2", &context},
+                                           {"TestState2", "TestState1", &context}}));
+    }
+}
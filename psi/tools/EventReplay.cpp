@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#define LOG_TRACE(x)                                                                                                   \
+    do {                                                                                                               \
+    } while (0)
+
+#include "psi/sm/BaseContext.h"
+#include "psi/sm/BaseState.h"
+#include "psi/sm/EventLog.h"
+#include "psi/sm/ReplaySimulator.h"
+
+/**
+ * Offline simulator replaying recorded order events through one context per order.
+ * Recording is a file of fixed-size records written by @EventLogWriter, it is memory-mapped and partitioned
+ * by order id between all cores. Final states of orders and aggregate statistics are reported.
+ * States of this tool are a sample, real backtests link their own states and decoding of records.
+ *
+ * Usage:
+ *   EventReplay generate <file> [events] [orders]   - writes synthetic recording
+ *   EventReplay run <file> [threads]                - replays recording
+ */
+
+namespace {
+
+using namespace psi::sm;
+
+enum class RecordType : uint32_t
+{
+    New,
+    Fill,
+    Amend,
+    Cancel,
+};
+
+/// @brief recorded event, 24 bytes
+struct Record {
+    uint64_t order;
+    uint64_t timestamp;
+    RecordType type;
+    uint32_t quantity;
+};
+
+struct EvNew {
+    uint32_t quantity;
+};
+
+struct EvFill {
+    uint32_t quantity;
+};
+
+struct EvAmend {
+    uint32_t quantity;
+};
+
+struct EvCancel {
+};
+
+struct IOrderState {
+    virtual ~IOrderState() = default;
+
+    virtual const std::string &name() const = 0;
+
+    virtual ProcessResult react(const EvNew &) = 0;
+    virtual ProcessResult react(const EvFill &) = 0;
+    virtual ProcessResult react(const EvAmend &) = 0;
+    virtual ProcessResult react(const EvCancel &) = 0;
+};
+
+struct OrderContext : BaseContext<IOrderState> {
+    explicit OrderContext(std::pmr::memory_resource *resource);
+
+    using BaseContext<IOrderState>::queueSize;
+
+    uint32_t remaining = 0;
+    uint32_t filled = 0;
+
+    /// @brief events which do not fit order's lifecycle, e.g. fill of unknown order
+    uint32_t anomalies = 0;
+};
+
+struct Pending : BaseState<IOrderState> {
+    Pending()
+        : BaseState<IOrderState>("Pending")
+    {
+    }
+
+    ProcessResult react(const EvNew &ev) override;
+
+    ProcessResult react(const EvFill &) override
+    {
+        // fill may be recorded before acknowledgement of order
+        return defer_event();
+    }
+
+    ProcessResult react(const EvAmend &) override
+    {
+        return defer_event();
+    }
+
+    ProcessResult react(const EvCancel &) override;
+};
+
+struct Working : BaseState<IOrderState> {
+    Working()
+        : BaseState<IOrderState>("Working")
+    {
+    }
+
+    ProcessResult react(const EvNew &) override
+    {
+        ++context<OrderContext>()->anomalies;
+        return discard_event();
+    }
+
+    ProcessResult react(const EvFill &ev) override;
+
+    ProcessResult react(const EvAmend &ev) override
+    {
+        auto *ctx = context<OrderContext>();
+        ctx->remaining = ev.quantity > ctx->filled ? ev.quantity - ctx->filled : 0;
+        return discard_event();
+    }
+
+    ProcessResult react(const EvCancel &) override;
+};
+
+/// @brief Final state, all further events are anomalies.
+template <typename Tag>
+struct Final : BaseState<IOrderState> {
+    Final()
+        : BaseState<IOrderState>(Tag::name)
+    {
+    }
+
+    ProcessResult react(const EvNew &) override
+    {
+        return anomaly();
+    }
+
+    ProcessResult react(const EvFill &) override
+    {
+        return anomaly();
+    }
+
+    ProcessResult react(const EvAmend &) override
+    {
+        return anomaly();
+    }
+
+    ProcessResult react(const EvCancel &) override
+    {
+        return anomaly();
+    }
+
+private:
+    ProcessResult anomaly()
+    {
+        ++context<OrderContext>()->anomalies;
+        return discard_event();
+    }
+};
+
+struct FilledTag {
+    static constexpr const char *name = "Filled";
+};
+
+struct CancelledTag {
+    static constexpr const char *name = "Cancelled";
+};
+
+using Filled = Final<FilledTag>;
+using Cancelled = Final<CancelledTag>;
+
+OrderContext::OrderContext(std::pmr::memory_resource *resource)
+    : BaseContext<IOrderState>(resource)
+{
+    transit<Pending>();
+}
+
+ProcessResult Pending::react(const EvNew &ev)
+{
+    context<OrderContext>()->remaining = ev.quantity;
+    return transit<Working>();
+}
+
+ProcessResult Pending::react(const EvCancel &)
+{
+    return transit<Cancelled>();
+}
+
+ProcessResult Working::react(const EvFill &ev)
+{
+    auto *ctx = context<OrderContext>();
+    ctx->filled += ev.quantity;
+    ctx->remaining = ev.quantity < ctx->remaining ? ctx->remaining - ev.quantity : 0;
+    return ctx->remaining ? discard_event() : transit<Filled>();
+}
+
+ProcessResult Working::react(const EvCancel &)
+{
+    return transit<Cancelled>();
+}
+
+void feed(OrderContext &context, const Record &record)
+{
+    switch (record.type) {
+    case RecordType::New:
+        context.process_event(EvNew {record.quantity});
+        break;
+    case RecordType::Fill:
+        context.process_event(EvFill {record.quantity});
+        break;
+    case RecordType::Amend:
+        context.process_event(EvAmend {record.quantity});
+        break;
+    case RecordType::Cancel:
+        context.process_event(EvCancel {});
+        break;
+    }
+}
+
+int generate(const std::string &path, size_t events, size_t orders)
+{
+    auto writer = EventLogWriter<Record>::create(path);
+    if (!writer) {
+        std::cerr << "Can not create " << path << std::endl;
+        return 1;
+    }
+
+    // slot of book is reused by next order once previous one is done
+    struct Order {
+        uint64_t generation = 0;
+        uint32_t quantity = 0;
+        uint32_t left = 0;
+        bool created = false;
+    };
+    std::vector<Order> book(orders);
+    std::mt19937_64 rng(42);
+
+    uint64_t timestamp = 0;
+    for (size_t i = 0; i < events; ++i) {
+        const uint64_t slot = rng() % orders;
+        auto &order = book[slot];
+        Record record {order.generation * orders + slot, ++timestamp, RecordType::New, 0};
+        bool done = false;
+        if (!order.created) {
+            order.created = true;
+            order.quantity = order.left = 100 + static_cast<uint32_t>(rng() % 900);
+            record.quantity = order.quantity;
+        } else {
+            const auto dice = rng() % 100;
+            if (dice < 2) {
+                record.type = RecordType::Cancel;
+                done = true;
+            } else if (dice < 10) {
+                record.type = RecordType::Amend;
+                record.quantity = order.quantity += 10;
+                order.left += 10;
+            } else {
+                record.type = RecordType::Fill;
+                record.quantity = std::min<uint32_t>(order.left, 1 + static_cast<uint32_t>(rng() % 50));
+                order.left -= record.quantity;
+                done = order.left == 0;
+            }
+        }
+        if (done) {
+            order = Order {order.generation + 1};
+        }
+        writer->append(record);
+    }
+
+    std::cout << "written " << writer->size() << " events of " << orders << " concurrent orders to " << path
+              << std::endl;
+    return 0;
+}
+
+int run(const std::string &path, unsigned threads)
+{
+    auto reader = EventLogReader<Record>::open(path);
+    if (!reader) {
+        std::cerr << "Can not open " << path << std::endl;
+        return 1;
+    }
+
+    ReplaySimulator<OrderContext> simulator(
+        [](uint64_t, std::pmr::memory_resource *resource) { return std::make_unique<OrderContext>(resource); },
+        threads);
+    const auto stats = simulator.run(
+        reader->data(), reader->size(), [](const Record &record) { return record.order; }, &feed);
+
+    std::map<std::string, size_t> states;
+    uint64_t filled = 0;
+    uint64_t anomalies = 0;
+    size_t pending = 0;
+    simulator.forEach([&](uint64_t, OrderContext &context) {
+        context.observeState([&](const IOrderState *st) { ++states[st ? st->name() : "<none>"]; });
+        filled += context.filled;
+        anomalies += context.anomalies;
+        pending += context.queueSize();
+    });
+
+    const auto ms = [](std::chrono::nanoseconds ns) { return static_cast<double>(ns.count()) / 1e6; };
+    std::cout << "events: " << stats.events << ", orders: " << stats.contexts << ", threads: " << simulator.shards()
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << "partition: " << ms(stats.partitionTime)
+              << " ms, replay: " << ms(stats.replayTime) << " ms, "
+              << static_cast<double>(stats.events) / std::max(ms(stats.partitionTime + stats.replayTime), 1e-3) / 1e3
+              << " M events/s" << std::endl;
+
+    const auto [minShard, maxShard] = std::minmax_element(stats.shardEvents.begin(), stats.shardEvents.end());
+    std::cout << "events per shard: min " << *minShard << ", max " << *maxShard << std::endl;
+
+    std::cout << "final states:" << std::endl;
+    for (const auto &[name, count] : states) {
+        std::cout << std::setw(12) << name << std::setw(12) << count << std::endl;
+    }
+    std::cout << "filled quantity: " << filled << ", anomalies: " << anomalies << ", events left deferred: " << pending
+              << std::endl;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (argc < 3 || (mode != "generate" && mode != "run")) {
+        std::cerr << "Usage: " << argv[0] << " generate <file> [events] [orders] | run <file> [threads]" << std::endl;
+        return 1;
+    }
+
+    if (mode == "generate") {
+        const size_t events = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 10000000;
+        const size_t orders = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 100000;
+        return generate(argv[2], events, std::max<size_t>(orders, 1));
+    }
+
+    const unsigned threads = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : std::thread::hardware_concurrency();
+    return run(argv[2], threads);
+}
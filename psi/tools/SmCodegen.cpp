@@ -0,0 +1,743 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Generator of switch-dispatched state machines from compact description.
+ * Generated machine has no virtual calls and no state objects, but keeps semantics of BaseContext:
+ * deferred events are re-processed after state change, posted events are processed before deferred ones,
+ * events passed to machine by actions are handled after current reaction.
+ *
+ * Description (one declaration per line, '#' starts comment):
+ *   namespace psi::examples                  - namespace of generated code, optional
+ *   machine Door                             - generates 'DoorMachine<Actions>' and 'DoorState'
+ *   event Open                               - generates empty event struct
+ *   event Lock { uint32_t code; }            - body of event struct is copied as is
+ *   state Closed                             - first state is initial
+ *   state Locked entry onLocked exit onLeft  - actions called on entry and exit of state
+ *   Closed + Open -> Opened                  - transition
+ *   Closed + Lock [isValid] -> Locked / onLock - guarded transition with action
+ *   Closed + Knock -> Opened post            - transition, then event is posted to be processed by new state
+ *   Locked + Open defer                      - event is deferred until state is changed
+ *   Opened + Open discard                    - event is consumed without action
+ *   Opened + Ping / onPing                   - internal reaction, state is not changed
+ *   * + Ping / onPing                        - rule for every state, applied after rules of state
+ *
+ * Rules of one state and event are tried in order of declaration, event without matching rule is unconsumed.
+ * Actions and guards are methods of 'Actions' object passed to machine:
+ *   void onLock(DoorMachine<Actions> &machine, const Lock &ev);
+ *   bool isValid(const DoorMachine<Actions> &machine, const Lock &ev);
+ *   void onLocked(DoorMachine<Actions> &machine);
+ *
+ * Usage: SmCodegen <description> <output header>
+ */
+
+namespace {
+
+struct Event {
+    std::string name;
+    std::string body;
+};
+
+struct State {
+    std::string name;
+    std::string entry;
+    std::string exit;
+};
+
+enum class Kind
+{
+    Transit,
+    Defer,
+    Discard,
+};
+
+struct Rule {
+    int line = 0;
+    std::string state;
+    std::string event;
+    std::string guard;
+    Kind kind = Kind::Discard;
+    std::string target;
+    bool post = false;
+    std::string action;
+};
+
+struct Machine {
+    std::string ns;
+    std::string name;
+    std::vector<Event> events;
+    std::vector<State> states;
+    std::vector<Rule> rules;
+};
+
+class Parser
+{
+public:
+    explicit Parser(std::string file)
+        : m_file(std::move(file))
+    {
+    }
+
+    std::optional<Machine> parse(std::istream &in)
+    {
+        std::string text;
+        while (std::getline(in, text)) {
+            ++m_line;
+            if (const auto comment = text.find('#'); comment != std::string::npos) {
+                text.erase(comment);
+            }
+
+            std::string body;
+            if (const auto brace = text.find('{'); brace != std::string::npos) {
+                const auto close = text.rfind('}');
+                if (close == std::string::npos || close < brace) {
+                    error("unterminated '{'");
+                    continue;
+                }
+                body = text.substr(brace + 1, close - brace - 1);
+                text.erase(brace);
+            }
+
+            const auto tokens = split(text);
+            if (!tokens.empty()) {
+                declaration(tokens, body);
+            }
+        }
+
+        validate();
+        if (m_errors) {
+            return std::nullopt;
+        }
+        return m_machine;
+    }
+
+private:
+    static std::vector<std::string> split(const std::string &text)
+    {
+        std::istringstream is(text);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (is >> token) {
+            tokens.emplace_back(token);
+        }
+        return tokens;
+    }
+
+    static bool isIdentifier(const std::string &s)
+    {
+        if (s.empty() || (!std::isalpha(static_cast<unsigned char>(s[0])) && s[0] != '_')) {
+            return false;
+        }
+        return std::all_of(s.begin(), s.end(), [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+    }
+
+    void error(const std::string &message, int line = 0)
+    {
+        std::cerr << m_file << ":" << (line ? line : m_line) << ": error: " << message << std::endl;
+        ++m_errors;
+    }
+
+    void identifier(const std::string &s, const char *what)
+    {
+        if (!isIdentifier(s)) {
+            error(std::string("invalid ") + what + " '" + s + "'");
+        }
+    }
+
+    void declaration(const std::vector<std::string> &t, const std::string &body)
+    {
+        if (t[0] == "namespace" && t.size() == 2) {
+            m_machine.ns = t[1];
+        } else if (t[0] == "machine" && t.size() == 2) {
+            identifier(t[1], "machine name");
+            m_machine.name = t[1];
+        } else if (t[0] == "event" && t.size() == 2) {
+            identifier(t[1], "event name");
+            m_machine.events.emplace_back(Event {t[1], body});
+        } else if (t[0] == "state" && t.size() >= 2) {
+            identifier(t[1], "state name");
+            State state {t[1], {}, {}};
+            for (size_t i = 2; i < t.size(); i += 2) {
+                if (i + 1 == t.size() || (t[i] != "entry" && t[i] != "exit")) {
+                    error("expected 'entry <action>' or 'exit <action>'");
+                    return;
+                }
+                identifier(t[i + 1], "action name");
+                (t[i] == "entry" ? state.entry : state.exit) = t[i + 1];
+            }
+            m_machine.states.emplace_back(state);
+        } else if (t.size() >= 4 && t[1] == "+") {
+            rule(t);
+        } else {
+            error("unknown declaration '" + t[0] + "'");
+        }
+    }
+
+    void rule(const std::vector<std::string> &t)
+    {
+        Rule rule;
+        rule.line = m_line;
+        rule.state = t[0];
+        rule.event = t[2];
+        if (rule.state != "*") {
+            identifier(rule.state, "state name");
+        }
+        identifier(rule.event, "event name");
+
+        size_t i = 3;
+        if (i < t.size() && t[i].size() > 2 && t[i].front() == '[' && t[i].back() == ']') {
+            rule.guard = t[i].substr(1, t[i].size() - 2);
+            identifier(rule.guard, "guard name");
+            ++i;
+        }
+
+        if (i < t.size() && t[i] == "->") {
+            if (++i == t.size()) {
+                error("expected target state");
+                return;
+            }
+            rule.kind = Kind::Transit;
+            rule.target = t[i++];
+            identifier(rule.target, "state name");
+            if (i < t.size() && t[i] == "post") {
+                rule.post = true;
+                ++i;
+            }
+        } else if (i < t.size() && t[i] == "defer") {
+            rule.kind = Kind::Defer;
+            ++i;
+        } else if (i < t.size() && t[i] == "discard") {
+            ++i;
+        }
+
+        if (i < t.size() && t[i] == "/") {
+            if (rule.kind == Kind::Defer) {
+                error("deferred event can not have action");
+                return;
+            }
+            if (++i == t.size()) {
+                error("expected action name");
+                return;
+            }
+            rule.action = t[i++];
+            identifier(rule.action, "action name");
+        }
+
+        if (i != t.size()) {
+            error("unexpected '" + t[i] + "'");
+            return;
+        }
+        if (rule.kind == Kind::Discard && rule.action.empty() && i == 3 + (rule.guard.empty() ? 0 : 1)) {
+            error("rule has no reaction, expected '->', 'defer', 'discard' or '/'");
+            return;
+        }
+        m_machine.rules.emplace_back(rule);
+    }
+
+    void validate()
+    {
+        if (m_machine.name.empty()) {
+            error("missing 'machine' declaration", 1);
+        }
+        if (m_machine.states.empty()) {
+            error("machine has no states", 1);
+        }
+        if (m_machine.events.empty()) {
+            error("machine has no events", 1);
+        }
+
+        std::set<std::string> states;
+        for (const auto &s : m_machine.states) {
+            if (!states.insert(s.name).second) {
+                error("duplicate state '" + s.name + "'", 1);
+            }
+        }
+        std::set<std::string> events;
+        for (const auto &e : m_machine.events) {
+            if (!events.insert(e.name).second) {
+                error("duplicate event '" + e.name + "'", 1);
+            }
+        }
+        for (const auto &r : m_machine.rules) {
+            if (r.state != "*" && !states.count(r.state)) {
+                error("unknown state '" + r.state + "'", r.line);
+            }
+            if (!events.count(r.event)) {
+                error("unknown event '" + r.event + "'", r.line);
+            }
+            if (r.kind == Kind::Transit && !states.count(r.target)) {
+                error("unknown state '" + r.target + "'", r.line);
+            }
+        }
+    }
+
+    std::string m_file;
+    int m_line = 0;
+    int m_errors = 0;
+    Machine m_machine;
+};
+
+class Generator
+{
+public:
+    Generator(const Machine &m, std::string source)
+        : m(m)
+        , m_source(std::move(source))
+        , m_class(m.name + "Machine")
+        , m_state(m.name + "State")
+    {
+    }
+
+    std::string generate()
+    {
+        header();
+        events();
+        states();
+        machine();
+        if (!m.ns.empty()) {
+            o << "} // namespace " << m.ns << "\n";
+        }
+        return o.str();
+    }
+
+private:
+    void header()
+    {
+        o << "// Generated by SmCodegen from " << m_source << ", do not edit.\n"
+          << "#pragma once\n\n"
+          << "#include <atomic>\n"
+          << "#include <cstdint>\n"
+          << "#include <mutex>\n"
+          << "#include <variant>\n"
+          << "#include <vector>\n\n"
+          << "#include \"psi/sm/CompactRecursiveMutex.h\"\n"
+          << "#include \"psi/sm/ProcessResult.h\"\n\n";
+        if (!m.ns.empty()) {
+            o << "namespace " << m.ns << " {\n\n";
+        }
+    }
+
+    void events()
+    {
+        for (const auto &e : m.events) {
+            o << "struct " << e.name << " {\n";
+            const auto body = trim(e.body);
+            if (!body.empty()) {
+                o << "    " << body << "\n";
+            }
+            o << "};\n\n";
+        }
+    }
+
+    void states()
+    {
+        o << "/// @brief States of " << m.name << " machine.\n"
+          << "enum class " << m_state << " : uint16_t\n{\n";
+        for (const auto &s : m.states) {
+            o << "    " << s.name << ",\n";
+        }
+        o << "};\n\n"
+          << "inline const char *to_string(" << m_state << " state)\n{\n"
+          << "    switch (state) {\n";
+        for (const auto &s : m.states) {
+            o << "    case " << m_state << "::" << s.name << ":\n"
+              << "        return \"" << s.name << "\";\n";
+        }
+        o << "    }\n"
+          << "    return \"Unknown\";\n"
+          << "}\n\n";
+    }
+
+    void machine()
+    {
+        o << "/**\n"
+          << " * @brief " << m_class << " is a thread-safe state machine generated from " << m_source << ".\n"
+          << " * Reactions are dispatched by switch over current state, semantics of queues are the same as of\n"
+          << " * psi::sm::BaseContext. Initial state is " << m.states.front().name
+          << ", its entry action is not called.\n"
+          << " *\n"
+          << " * @tparam Actions type of object implementing actions and guards\n"
+          << " */\n"
+          << "template <typename Actions>\n"
+          << "class " << m_class << "\n{\n"
+          << "public:\n"
+          << "    using State = " << m_state << ";\n"
+          << "    using ProcessResult = ::psi::sm::ProcessResult;\n"
+          << "    using Mutex = ::psi::sm::CompactRecursiveMutex;\n\n"
+          << "    /// @brief Any event of machine, used by queues.\n"
+          << "    using Event = std::variant<" << join(m.events) << ">;\n\n"
+          << "    explicit " << m_class << "(Actions &actions)\n"
+          << "        : m_actions(actions)\n"
+          << "    {\n"
+          << "    }\n\n";
+
+        o << "    /**\n"
+          << "     * @brief Processes event in accordance with current state.\n"
+          << "     * If called by action, event is queued and processed once outermost reaction is finished.\n"
+          << "     */\n"
+          << "    template <typename T>\n"
+          << "    void process_event(const T &ev)\n"
+          << "    {\n"
+          << "        std::lock_guard<Mutex> lock(m_mutex);\n\n"
+          << "        if (m_dispatching) {\n"
+          << "            m_incoming.emplace_back(ev);\n"
+          << "            return;\n"
+          << "        }\n\n"
+          << "        DispatchGuard guard(m_dispatching);\n"
+          << "        dispatch(ev);\n"
+          << "        drainIncoming();\n"
+          << "    }\n\n"
+          << "    /// @brief Posts event to be processed with high priority.\n"
+          << "    template <typename T>\n"
+          << "    void post_event(const T &ev)\n"
+          << "    {\n"
+          << "        std::lock_guard<Mutex> lock(m_mutex);\n"
+          << "        m_posted.emplace_back(ev);\n"
+          << "    }\n\n"
+          << "    /// @brief Returns current state. Operation is thread-safe and lock-free.\n"
+          << "    State state() const\n"
+          << "    {\n"
+          << "        return m_state.load(std::memory_order_acquire);\n"
+          << "    }\n\n"
+          << "    /// @brief Returns number of queued events.\n"
+          << "    size_t queueSize() const\n"
+          << "    {\n"
+          << "        return m_posted.size() + m_deferred.size() + m_queue.size() - m_head + m_incoming.size();\n"
+          << "    }\n\n"
+          << "private:\n"
+          << "    struct DispatchGuard {\n"
+          << "        explicit DispatchGuard(bool &flag)\n"
+          << "            : m_flag(flag)\n"
+          << "        {\n"
+          << "            m_flag = true;\n"
+          << "        }\n\n"
+          << "        ~DispatchGuard()\n"
+          << "        {\n"
+          << "            m_flag = false;\n"
+          << "        }\n\n"
+          << "        bool &m_flag;\n"
+          << "    };\n\n";
+
+        for (const auto &e : m.events) {
+            react(e);
+        }
+
+        o << "    ProcessResult react(const Event &ev)\n"
+          << "    {\n"
+          << "        switch (ev.index()) {\n";
+        for (size_t i = 0; i < m.events.size(); ++i) {
+            o << "        case " << i << ":\n"
+              << "            return react(*std::get_if<" << i << ">(&ev));\n";
+        }
+        o << "        }\n"
+          << "        return ProcessResult::UnconsumedEvent;\n"
+          << "    }\n\n";
+
+        o << "    void transit(State next)\n"
+          << "    {\n";
+        if (hasExitActions()) {
+            o << "        switch (m_state.load(std::memory_order_relaxed)) {\n";
+            for (const auto &s : m.states) {
+                if (!s.exit.empty()) {
+                    o << "        case State::" << s.name << ":\n"
+                      << "            m_actions." << s.exit << "(*this);\n"
+                      << "            break;\n";
+                }
+            }
+            o << "        default:\n"
+              << "            break;\n"
+              << "        }\n";
+        }
+        o << "        m_state.store(next, std::memory_order_release);\n";
+        if (hasEntryActions()) {
+            o << "        switch (next) {\n";
+            for (const auto &s : m.states) {
+                if (!s.entry.empty()) {
+                    o << "        case State::" << s.name << ":\n"
+                      << "            m_actions." << s.entry << "(*this);\n"
+                      << "            break;\n";
+                }
+            }
+            o << "        default:\n"
+              << "            break;\n"
+              << "        }\n";
+        }
+        o << "    }\n\n";
+
+        o << R"(    template <typename T>
+    void dispatch(const T &ev)
+    {
+        switch (react(ev)) {
+        case ProcessResult::DeferredEvent:
+            m_deferred.emplace_back(ev);
+            break;
+        case ProcessResult::PostedEvent:
+            m_posted.emplace_back(ev);
+            processQueue();
+            break;
+        case ProcessResult::TransitState:
+            processQueue();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void dispatch(const Event &ev)
+    {
+        switch (ev.index()) {
+)";
+        for (size_t i = 0; i < m.events.size(); ++i) {
+            o << "        case " << i << ":\n"
+              << "            dispatch(*std::get_if<" << i << ">(&ev));\n"
+              << "            break;\n";
+        }
+        o << R"(        }
+    }
+
+    /// @brief Re-processes posted, pending and deferred events after state is changed.
+    void processQueue()
+    {
+        for (;;) {
+            if (!m_posted.empty()) {
+                m_posted.insert(m_posted.end(), m_queue.begin() + m_head, m_queue.end());
+                m_queue.swap(m_posted);
+                m_posted.clear();
+            } else {
+                m_queue.erase(m_queue.begin(), m_queue.begin() + m_head);
+            }
+            m_head = 0;
+            m_queue.insert(m_queue.end(), m_deferred.begin(), m_deferred.end());
+            m_deferred.clear();
+
+            bool transited = false;
+            while (!transited && m_head < m_queue.size()) {
+                Event ev = std::move(m_queue[m_head++]);
+                switch (react(ev)) {
+                case ProcessResult::DeferredEvent:
+                    m_deferred.emplace_back(std::move(ev));
+                    break;
+                case ProcessResult::PostedEvent:
+                    m_posted.emplace_back(std::move(ev));
+                    transited = true;
+                    break;
+                case ProcessResult::TransitState:
+                    transited = true;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (m_head == m_queue.size()) {
+                m_queue.clear();
+                m_head = 0;
+            }
+            if (!transited) {
+                return;
+            }
+        }
+    }
+
+    void drainIncoming()
+    {
+        while (!m_incoming.empty()) {
+            std::vector<Event> batch;
+            batch.swap(m_incoming);
+            for (const auto &ev : batch) {
+                dispatch(ev);
+            }
+        }
+    }
+
+    Actions &m_actions;
+    Mutex m_mutex;
+)";
+        o << "    std::atomic<State> m_state {State::" << m.states.front().name << "};\n"
+          << R"(    bool m_dispatching = false;
+
+    std::vector<Event> m_posted;
+    std::vector<Event> m_deferred;
+    std::vector<Event> m_queue;
+    size_t m_head = 0;
+    std::vector<Event> m_incoming;
+};
+
+)";
+    }
+
+    /// @brief Emits reaction on event: switch over states, rules of state are tried in order.
+    void react(const Event &e)
+    {
+        o << "    ProcessResult react(const " << e.name << " &ev)\n"
+          << "    {\n";
+
+        std::vector<std::pair<const State *, std::vector<const Rule *>>> cases;
+        for (const auto &s : m.states) {
+            std::vector<const Rule *> rules;
+            for (const auto &r : m.rules) {
+                if (r.event == e.name && r.state == s.name) {
+                    rules.emplace_back(&r);
+                }
+            }
+            for (const auto &r : m.rules) {
+                if (r.event == e.name && r.state == "*") {
+                    rules.emplace_back(&r);
+                }
+            }
+            if (!rules.empty()) {
+                cases.emplace_back(&s, rules);
+            }
+        }
+
+        if (cases.empty()) {
+            o << "        (void)ev;\n"
+              << "        return ProcessResult::UnconsumedEvent;\n"
+              << "    }\n\n";
+            return;
+        }
+
+        bool usesEvent = false;
+        for (const auto &[s, rules] : cases) {
+            for (const auto *r : rules) {
+                usesEvent = usesEvent || !r->guard.empty() || !r->action.empty();
+            }
+        }
+        if (!usesEvent) {
+            o << "        (void)ev;\n";
+        }
+
+        o << "        switch (m_state.load(std::memory_order_relaxed)) {\n";
+        for (const auto &[s, rules] : cases) {
+            o << "        case State::" << s->name << ":\n";
+            bool unconditional = false;
+            for (const auto *r : rules) {
+                std::string indent = "            ";
+                if (!r->guard.empty()) {
+                    o << indent << "if (m_actions." << r->guard << "(*this, ev)) {\n";
+                    indent += "    ";
+                }
+                reaction(*r, indent);
+                if (!r->guard.empty()) {
+                    o << "            }\n";
+                } else {
+                    unconditional = true;
+                    break;
+                }
+            }
+            if (!unconditional) {
+                o << "            return ProcessResult::UnconsumedEvent;\n";
+            }
+        }
+        o << "        default:\n"
+          << "            return ProcessResult::UnconsumedEvent;\n"
+          << "        }\n"
+          << "    }\n\n";
+    }
+
+    void reaction(const Rule &r, const std::string &indent)
+    {
+        if (!r.action.empty()) {
+            o << indent << "m_actions." << r.action << "(*this, ev);\n";
+        }
+        switch (r.kind) {
+        case Kind::Transit:
+            o << indent << "transit(State::" << r.target << ");\n"
+              << indent << "return ProcessResult::" << (r.post ? "PostedEvent" : "TransitState") << ";\n";
+            break;
+        case Kind::Defer:
+            o << indent << "return ProcessResult::DeferredEvent;\n";
+            break;
+        case Kind::Discard:
+            o << indent << "return ProcessResult::DiscardedEvent;\n";
+            break;
+        }
+    }
+
+    bool hasEntryActions() const
+    {
+        return std::any_of(m.states.begin(), m.states.end(), [](const State &s) { return !s.entry.empty(); });
+    }
+
+    bool hasExitActions() const
+    {
+        return std::any_of(m.states.begin(), m.states.end(), [](const State &s) { return !s.exit.empty(); });
+    }
+
+    static std::string join(const std::vector<Event> &events)
+    {
+        std::string result;
+        for (const auto &e : events) {
+            result += (result.empty() ? "" : ", ") + e.name;
+        }
+        return result;
+    }
+
+    static std::string trim(const std::string &s)
+    {
+        const auto begin = s.find_first_not_of(" \t");
+        if (begin == std::string::npos) {
+            return {};
+        }
+        return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+    }
+
+    const Machine &m;
+    std::string m_source;
+    std::string m_class;
+    std::string m_state;
+    std::ostringstream o;
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <description> <output header>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << argv[1] << ": error: can not open file" << std::endl;
+        return 1;
+    }
+
+    const auto machine = Parser(argv[1]).parse(in);
+    if (!machine) {
+        return 1;
+    }
+
+    std::string source = argv[1];
+    if (const auto slash = source.find_last_of("/\\"); slash != std::string::npos) {
+        source.erase(0, slash + 1);
+    }
+    const auto code = Generator(*machine, source).generate();
+
+    // header is not rewritten if it is not changed, so dependent sources are not rebuilt
+    {
+        std::ifstream old(argv[2]);
+        std::stringstream current;
+        current << old.rdbuf();
+        if (old && current.str() == code) {
+            return 0;
+        }
+    }
+
+    std::ofstream out(argv[2]);
+    out << code;
+    if (!out) {
+        std::cerr << argv[2] << ": error: can not write file" << std::endl;
+        return 1;
+    }
+    return 0;
+}